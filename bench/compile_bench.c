@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "vm.h"
+
+#define DEFAULT_BLOCKS 2000
+#define RUNS 5
+// nesting of each block, and the locals every level of it declares
+#define DEPTH 8
+#define LOCALS_PER_LEVEL 30
+
+static uint32_t seed = 12345;
+
+static uint32_t nextRandom() {
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// builds what a code generator might write: blocks nested DEPTH deep,
+// each level declaring LOCALS_PER_LEVEL locals with long, similar names
+// from the ones already in scope, some of them shadowing outer ones.
+// nothing in it adds to the constant table.
+static char* generateSource(int blocks) {
+    size_t capacity = (size_t)blocks * DEPTH * LOCALS_PER_LEVEL * 96 + 1;
+    char* source = malloc(capacity);
+    size_t length = 0;
+    for (int block = 0; block < blocks; block++) {
+        for (int level = 0; level < DEPTH; level++) {
+            length += sprintf(source + length, "%*s{\n", level * 2, "");
+            for (int i = 0; i < LOCALS_PER_LEVEL; i++) {
+                int indent = level * 2 + 2;
+                // the first few reuse the names of the level above
+                int nameLevel = i < 3 && level > 0 ? level - 1 : level;
+                if (i == 0 && level == 0) {
+                    length += sprintf(source + length,
+                                      "%*svar generated_local_%d_%d = true;\n",
+                                      indent, "", nameLevel, i);
+                    continue;
+                }
+                int fromLevel = nextRandom() % (level + 1);
+                int from = nextRandom() % (fromLevel == level && i > 0
+                                               ? i
+                                               : LOCALS_PER_LEVEL);
+                length += sprintf(source + length,
+                                  "%*svar generated_local_%d_%d = "
+                                  "generated_local_%d_%d;\n",
+                                  indent, "", nameLevel, i, fromLevel, from);
+            }
+        }
+        for (int level = DEPTH - 1; level >= 0; level--) {
+            length += sprintf(source + length, "%*s}\n", level * 2, "");
+        }
+    }
+    source[length] = '\0';
+    return source;
+}
+
+int main(int argc, const char* argv[]) {
+    int blocks = argc > 1 ? atoi(argv[1]) : DEFAULT_BLOCKS;
+    char* source = generateSource(blocks);
+    size_t length = strlen(source);
+
+    VM vm;
+    initVM(&vm);
+    double best = 0;
+    int bytes = 0;
+    for (int run = 0; run < RUNS; run++) {
+        Chunk chunk;
+        initChunk(&chunk);
+        double start = now();
+        if (!compile(&vm, source, &chunk)) {
+            fprintf(stderr, "compile_bench: the source didn't compile\n");
+            return 1;
+        }
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+        bytes = chunk.count;
+        freeChunk(&chunk);
+    }
+    freeVM(&vm);
+
+    printf("compile: %.1f MB in %.3f s, %d locals, %d bytes of code, "
+           "%.1f MB/s\n",
+           length / (1024.0 * 1024.0), best,
+           blocks * DEPTH * LOCALS_PER_LEVEL, bytes,
+           length / (1024.0 * 1024.0) / best);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "intern.h"
+#include "object.h"
+#include "vm.h"
+
+#define PREINTERNED 4096
+#define LOOKUPS_PER_THREAD 2000000
+#define INSERTS_PER_THREAD 50000
+#define MAX_THREADS 64
+
+static char names[PREINTERNED][32];
+
+typedef struct {
+    int id;
+    int inserts;
+} Worker;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// what a vm running a shared program does for every string it makes:
+// most of them are already in the table
+static void* lookupWorker(void* arg) {
+    Worker* worker = (Worker*)arg;
+    VM vm;
+    initVM(&vm);
+    uint32_t index = worker->id * 7919u;
+    for (int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+        index = (index + 2654435761u) % PREINTERNED;
+        copyString(&vm, names[index], strlen(names[index]));
+    }
+    freeVM(&vm);
+    return NULL;
+}
+
+// what compiling programs on many threads does: every thread adds new
+// strings, half of them also added by the thread next to it
+static void* insertWorker(void* arg) {
+    Worker* worker = (Worker*)arg;
+    VM vm;
+    initVM(&vm);
+    vm.internShared = true;
+    char name[48];
+    for (int i = 0; i < worker->inserts; i++) {
+        int owner = i % 2 == 0 ? worker->id : worker->id / 2 * 2;
+        int length = sprintf(name, "identifier_%d_%d", owner, i);
+        copyString(&vm, name, length);
+    }
+    freeVM(&vm);
+    return NULL;
+}
+
+static double runThreads(void* (*work)(void*), int threads, int inserts) {
+    pthread_t ids[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    double start = now();
+    for (int i = 0; i < threads; i++) {
+        workers[i].id = i;
+        workers[i].inserts = inserts;
+        pthread_create(&ids[i], NULL, work, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++) pthread_join(ids[i], NULL);
+    return now() - start;
+}
+
+static void preintern() {
+    VM vm;
+    initVM(&vm);
+    vm.internShared = true;
+    for (int i = 0; i < PREINTERNED; i++) {
+        int length = sprintf(names[i], "name_%d", i);
+        copyString(&vm, names[i], length);
+    }
+    freeVM(&vm);
+}
+
+int main(int argc, const char* argv[]) {
+    int maxThreads = argc > 1 ? atoi(argv[1]) : MAX_THREADS;
+    if (maxThreads < 1 || maxThreads > MAX_THREADS) maxThreads = MAX_THREADS;
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        preintern();
+        double elapsed = runThreads(lookupWorker, threads, 0);
+        double lookups = (double)threads * LOOKUPS_PER_THREAD;
+        printf("lookup %2d threads: %.3f s, %.1f M lookups/s\n", threads,
+               elapsed, lookups / elapsed / 1e6);
+
+        elapsed = runThreads(insertWorker, threads, INSERTS_PER_THREAD);
+        double inserts = (double)threads * INSERTS_PER_THREAD;
+        printf("insert %2d threads: %.3f s, %.1f M inserts/s, %d strings\n",
+               threads, elapsed, inserts / elapsed / 1e6,
+               sharedStringCount());
+        freeSharedStrings();
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory.h"
+#include "optimize.h"
+#include "vm.h"
+
+#define DEFAULT_WARMUPS 2
+#define DEFAULT_RUNS 10
+
+// off compares against the plain interpreter
+static bool jit = true;
+// see optimize.h
+static int optLevel = OPT_LEVEL_NONE;
+// runs each script at OPT_LEVEL_NONE and at optLevel first, and fails
+// the benchmark if the two don't print and end the same
+static bool check = false;
+
+typedef struct {
+    double seconds;
+    uint64_t instructions;
+    size_t allocations;
+    size_t bytes;
+} Sample;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char* readFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+    fseek(file, 0L, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file);
+    char* buffer = malloc(fileSize + 1);
+    size_t bytesRead = fread(buffer, 1, fileSize, file);
+    buffer[bytesRead] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+// the benchmark name is the file name without directory or extension
+static void benchmarkName(const char* path, char* name, size_t size) {
+    const char* start = strrchr(path, '/');
+    start = start == NULL ? path : start + 1;
+    size_t length = strcspn(start, ".");
+    if (length >= size) length = size - 1;
+    memcpy(name, start, length);
+    name[length] = '\0';
+}
+
+static bool runOnce(VM* vm, const char* source, FILE* sink, Sample* sample) {
+    initVM(vm);
+    vm->jitEnabled = jit;
+    vm->optLevel = optLevel;
+    // source outlives the vm
+    vm->borrowSource = true;
+    initOutput(&vm->output, sink);
+    size_t allocations = allocationCount;
+    size_t bytes = bytesAllocated;
+
+    double start = now();
+    InterpretResult result = interpret(vm, source);
+    sample->seconds = now() - start;
+
+    sample->instructions = vm->instructionCount;
+    sample->allocations = allocationCount - allocations;
+    sample->bytes = bytesAllocated - bytes;
+    freeVM(vm);
+    return result == INTERPRET_OK;
+}
+
+// the output and errors of a run of source at level
+static InterpretResult runCaptured(const char* source, int level,
+                                   char** output, size_t* length) {
+    FILE* file = open_memstream(output, length);
+    VM vm;
+    initVM(&vm);
+    vm.jitEnabled = jit;
+    vm.optLevel = level;
+    initOutput(&vm.output, file);
+    vm.errorFile = file;
+    InterpretResult result = interpret(&vm, source);
+    flushOutput(&vm.output);
+    freeVM(&vm);
+    fclose(file);
+    return result;
+}
+
+static bool sameBehavior(const char* name, const char* source) {
+    char* outputs[2];
+    size_t lengths[2];
+    InterpretResult results[2];
+    results[0] = runCaptured(source, OPT_LEVEL_NONE, &outputs[0],
+                             &lengths[0]);
+    results[1] = runCaptured(source, optLevel, &outputs[1], &lengths[1]);
+    bool same = results[0] == results[1] && lengths[0] == lengths[1] &&
+                memcmp(outputs[0], outputs[1], lengths[0]) == 0;
+    if (!same) {
+        fprintf(stderr, "%s: --opt-level %d changes what it does\n", name,
+                optLevel);
+    }
+    free(outputs[0]);
+    free(outputs[1]);
+    return same;
+}
+
+static int compareSamples(const void* a, const void* b) {
+    double x = ((const Sample*)a)->seconds;
+    double y = ((const Sample*)b)->seconds;
+    return (x > y) - (x < y);
+}
+
+// nearest rank percentile over samples sorted by time
+static double percentile(Sample* samples, int count, int p) {
+    int rank = (p * count + 99) / 100;
+    if (rank < 1) rank = 1;
+    return samples[rank - 1].seconds;
+}
+
+static bool runBenchmark(const char* path, int warmups, int runs,
+                         FILE* sink) {
+    char name[256];
+    benchmarkName(path, name, sizeof(name));
+    char* source = readFile(path);
+    Sample* samples = malloc(sizeof(Sample) * runs);
+    VM vm;
+
+    bool ok = !check || sameBehavior(name, source);
+    if (!ok) {
+        free(samples);
+        free(source);
+        return false;
+    }
+    for (int i = 0; i < warmups && ok; i++) {
+        ok = runOnce(&vm, source, sink, &samples[0]);
+    }
+    for (int i = 0; i < runs && ok; i++) {
+        ok = runOnce(&vm, source, sink, &samples[i]);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: script failed\n", name);
+        free(samples);
+        free(source);
+        return false;
+    }
+
+    // every run does the same work, so counters come from the last one
+    Sample last = samples[runs - 1];
+    qsort(samples, runs, sizeof(Sample), compareSamples);
+    double median = percentile(samples, runs, 50);
+    printf(
+        "{\"benchmark\": \"%s\", \"jit\": %s, \"runs\": %d, "
+        "\"median_ms\": %.3f, \"p95_ms\": %.3f, \"min_ms\": %.3f, "
+        "\"instructions\": %llu, \"instructions_per_sec\": %.0f, "
+        "\"allocations\": %zu, \"bytes_retained\": %zu}\n",
+        name, jit ? "true" : "false", runs, median * 1e3,
+        percentile(samples, runs, 95) * 1e3, samples[0].seconds * 1e3,
+        (unsigned long long)last.instructions, last.instructions / median,
+        last.allocations, last.bytes);
+    fflush(stdout);
+
+    free(samples);
+    free(source);
+    return true;
+}
+
+// usage: lox_bench [--warmup N] [--runs N] [--jit on|off] [--opt-level N]
+//                  [--check on|off] file.lox...
+// prints one JSON object per line and per benchmark
+int main(int argc, const char* argv[]) {
+    int warmups = DEFAULT_WARMUPS;
+    int runs = DEFAULT_RUNS;
+    int first = 1;
+    while (first + 1 < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--warmup") == 0) {
+            warmups = atoi(argv[first + 1]);
+        } else if (strcmp(argv[first], "--runs") == 0) {
+            runs = atoi(argv[first + 1]);
+        } else if (strcmp(argv[first], "--jit") == 0) {
+            jit = strcmp(argv[first + 1], "off") != 0;
+        } else if (strcmp(argv[first], "--opt-level") == 0) {
+            optLevel = atoi(argv[first + 1]);
+        } else if (strcmp(argv[first], "--check") == 0) {
+            check = strcmp(argv[first + 1], "off") != 0;
+        } else {
+            break;
+        }
+        first += 2;
+    }
+    if (first == argc || runs < 1) {
+        fprintf(stderr,
+                "Usage: lox_bench [--warmup N] [--runs N] [--jit on|off] "
+                "[--opt-level N] [--check on|off] file.lox...\n");
+        return 64;
+    }
+
+    FILE* sink = fopen("/dev/null", "w");
+    bool ok = true;
+    for (int i = first; i < argc; i++) {
+        ok &= runBenchmark(argv[i], warmups, runs, sink);
+    }
+    fclose(sink);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "number.h"
+
+#define ROUND_TRIPS 4000000
+#define LITERALS 1000000
+#define RUNS 5
+
+static uint64_t seed = 88172645463325252ull;
+
+static uint64_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool sameBits(double a, double b) { return memcmp(&a, &b, 8) == 0; }
+
+// any finite double printed with 17 significant digits has to come back
+// bit for bit, most of these take the slow path
+static int checkRoundTrips() {
+    char text[64];
+    int failures = 0;
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        uint64_t bits = nextRandom() & ~(1ull << 63);
+        double value;
+        memcpy(&value, &bits, 8);
+        if (value != value || value > 1.7976931348623157e308) continue;
+        int length = snprintf(text, sizeof(text), "%.17g", value);
+        if (!sameBits(parseNumber(text, length), value)) {
+            if (failures++ < 10) printf("round trip failed: %s\n", text);
+        }
+    }
+    return failures;
+}
+
+// formatNumber has to give back digits that parse to the same double
+static int checkFormatting() {
+    char text[NUMBER_BUFFER_SIZE];
+    int failures = 0;
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        uint64_t bits = nextRandom();
+        double value;
+        memcpy(&value, &bits, 8);
+        if (value != value || value - value != 0) continue;
+        int length = formatNumber(value, text);
+        if (!sameBits(parseNumber(text, length), value)) {
+            if (failures++ < 10) {
+                printf("format round trip failed: %.*s\n", length, text);
+            }
+        }
+    }
+    return failures;
+}
+
+// literals shaped like the ones in our data scripts: integers and
+// short decimals, compared against strtod
+static char* makeLiterals(int count, int** lengths) {
+    char* text = malloc((size_t)count * 32);
+    *lengths = malloc(sizeof(int) * count);
+    char* p = text;
+    for (int i = 0; i < count; i++) {
+        int decimals = nextRandom() % 7;
+        double value = (double)(nextRandom() % 100000000) / 100.0;
+        int length = sprintf(p, "%.*f", decimals, value);
+        (*lengths)[i] = length;
+        p += length + 1;
+    }
+    return text;
+}
+
+static int checkLiterals(const char* text, const int* lengths, int count) {
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        if (!sameBits(parseNumber(text, lengths[i]), strtod(text, NULL))) {
+            if (failures++ < 10) printf("literal mismatch: %s\n", text);
+        }
+        text += lengths[i] + 1;
+    }
+    return failures;
+}
+
+static double timeFormat(const char* text, const int* lengths, int count,
+                         bool useSnprintf) {
+    double* values = malloc(sizeof(double) * count);
+    for (int i = 0; i < count; i++) {
+        values[i] = parseNumber(text, lengths[i]);
+        text += lengths[i] + 1;
+    }
+    char buffer[64];
+    double best = 0;
+    volatile int sink = 0;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now();
+        for (int i = 0; i < count; i++) {
+            sink += useSnprintf ? snprintf(buffer, sizeof(buffer), "%.17g",
+                                           values[i])
+                                : formatNumber(values[i], buffer);
+        }
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    free(values);
+    return best;
+}
+
+static double timeParse(const char* text, const int* lengths, int count,
+                        bool useStrtod) {
+    double best = 0;
+    volatile double sink = 0;
+    for (int run = 0; run < RUNS; run++) {
+        const char* p = text;
+        double start = now();
+        for (int i = 0; i < count; i++) {
+            sink += useStrtod ? strtod(p, NULL) : parseNumber(p, lengths[i]);
+            p += lengths[i] + 1;
+        }
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main() {
+    int* lengths;
+    char* literals = makeLiterals(LITERALS, &lengths);
+
+    int failures = checkRoundTrips();
+    failures += checkLiterals(literals, lengths, LITERALS);
+    failures += checkFormatting();
+
+    double fast = timeParse(literals, lengths, LITERALS, false);
+    double slow = timeParse(literals, lengths, LITERALS, true);
+    printf("parseNumber: %.1f ns/literal\n", fast / LITERALS * 1e9);
+    printf("strtod:      %.1f ns/literal\n", slow / LITERALS * 1e9);
+
+    fast = timeFormat(literals, lengths, LITERALS, false);
+    slow = timeFormat(literals, lengths, LITERALS, true);
+    printf("formatNumber: %.1f ns/value\n", fast / LITERALS * 1e9);
+    printf("snprintf:     %.1f ns/value\n", slow / LITERALS * 1e9);
+    printf("%d mismatches\n", failures);
+
+    free(literals);
+    free(lengths);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scanner.h"
+
+#define DEFAULT_SIZE_MB 16
+#define RUNS 5
+
+static uint32_t seed = 12345;
+
+static uint32_t nextRandom() {
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// builds a data-script-like source: declarations with long identifiers,
+// numeric and string literals, comments and indentation
+static char* generateSource(size_t size) {
+    static const char* names[] = {"value", "total_amount", "row", "x",
+                                  "customer_identifier", "rate", "index"};
+    static const char* keywords[] = {"var", "print", "while", "true", "nil"};
+    char* source = malloc(size + 256);
+    size_t length = 0;
+    while (length < size) {
+        int indent = nextRandom() % 12;
+        memset(source + length, ' ', indent);
+        length += indent;
+        const char* name = names[nextRandom() % 7];
+        switch (nextRandom() % 4) {
+            case 0:
+                length += sprintf(source + length, "%s %s_%u = %u.%u;\n",
+                                  keywords[nextRandom() % 5], name,
+                                  nextRandom() % 1000, nextRandom() % 100000,
+                                  nextRandom() % 1000);
+                break;
+            case 1:
+                length += sprintf(source + length,
+                                  "%s = \"some string literal %u\" + %s;\n",
+                                  name, nextRandom() % 100, name);
+                break;
+            case 2:
+                length += sprintf(source + length,
+                                  "// a comment describing %s and its use\n",
+                                  name);
+                break;
+            default:
+                length += sprintf(source + length,
+                                  "print (%s * %u) <= %s / 2;\n\n", name,
+                                  nextRandom() % 100, name);
+                break;
+        }
+    }
+    source[length] = '\0';
+    return source;
+}
+
+int main(int argc, const char* argv[]) {
+    size_t sizeMB = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_SIZE_MB;
+    char* source = generateSource(sizeMB * 1024 * 1024);
+    size_t length = strlen(source);
+
+    double best = 0;
+    long tokens = 0;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now();
+        Scanner scanner;
+        initScanner(&scanner, source);
+        tokens = 0;
+        for (;;) {
+            Token token = scanToken(&scanner);
+            tokens++;
+            if (token.type == TOKEN_EOF) break;
+        }
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+
+    printf("scanner: %.1f MB in %.3f s, %ld tokens, %.1f MB/s\n",
+           length / (1024.0 * 1024.0), best, tokens,
+           length / (1024.0 * 1024.0) / best);
+
+    // same source through the batch pre-pass, which also pays for
+    // writing out the token buffer
+    TokenBuffer buffer;
+    initTokenBuffer(&buffer);
+    for (int run = 0; run < RUNS; run++) {
+        double start = now();
+        tokenize(&buffer, source);
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    printf("tokenize: %.1f MB in %.3f s, %d tokens, %.1f MB/s\n",
+           length / (1024.0 * 1024.0), best, buffer.count,
+           length / (1024.0 * 1024.0) / best);
+    freeTokenBuffer(&buffer);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "arena.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "memory.h"
+
+#define ARENA_MIN_BLOCK 65536
+// every allocation is aligned for any type
+#define ARENA_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size;
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+static ArenaBlock* newBlock(size_t size, ArenaBlock* next) {
+    ArenaBlock* block =
+        (ArenaBlock*)reallocate(NULL, 0, sizeof(ArenaBlock) + size);
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void freeBlocks(ArenaBlock* block) {
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        reallocate(block, sizeof(ArenaBlock) + block->size, 0);
+        block = next;
+    }
+}
+
+void initArena(Arena* arena) {
+    arena->blocks = NULL;
+    arena->used = 0;
+}
+
+void freeArena(Arena* arena) {
+    freeBlocks(arena->blocks);
+    initArena(arena);
+}
+
+void resetArena(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    if (block != NULL && block->next != NULL) {
+        // the next round gets everything this one used in one block
+        size_t size = 0;
+        for (ArenaBlock* each = block; each != NULL; each = each->next) {
+            size += each->size;
+        }
+        freeBlocks(block);
+        block = newBlock(size, NULL);
+        arena->blocks = block;
+    }
+    if (block != NULL) block->used = 0;
+    arena->used = 0;
+}
+
+void* arenaAllocate(Arena* arena, size_t size) {
+    size = ARENA_ALIGN(size);
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = block == NULL ? ARENA_MIN_BLOCK : block->size * 2;
+        if (blockSize < size) blockSize = size;
+        block = newBlock(blockSize, block);
+        arena->blocks = block;
+    }
+    void* result = block->data + block->used;
+    block->used += size;
+    arena->used += size;
+    return result;
+}
+
+void* arenaGrow(Arena* arena, void* pointer, size_t oldSize,
+                size_t newSize) {
+    ArenaBlock* block = arena->blocks;
+    size_t oldAligned = ARENA_ALIGN(oldSize);
+    size_t newAligned = ARENA_ALIGN(newSize);
+    if (pointer != NULL &&
+        (unsigned char*)pointer + oldAligned == block->data + block->used &&
+        block->used - oldAligned + newAligned <= block->size) {
+        // the last allocation, grown where it is
+        block->used += newAligned - oldAligned;
+        arena->used += newAligned - oldAligned;
+        return pointer;
+    }
+    void* result = arenaAllocate(arena, newSize);
+    if (pointer != NULL) memcpy(result, pointer, oldSize);
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef clox_arena_h
+#define clox_arena_h
+
+#include "common.h"
+
+// a bump allocator for scratch memory that is all given back at once
+// by resetArena(), such as what a compile needs along the way. its
+// blocks come from reallocate() and are kept across resets, so an arena
+// that is reused stops allocating once it has grown to fit.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    // the block allocations come from, earlier ones follow it
+    ArenaBlock* blocks;
+    // bytes handed out since the last reset
+    size_t used;
+} Arena;
+
+void initArena(Arena* arena);
+void freeArena(Arena* arena);
+// takes back everything allocated, keeping a single block large enough
+// for all of it
+void resetArena(Arena* arena);
+void* arenaAllocate(Arena* arena, size_t size);
+// a larger copy of an allocation
+void* arenaGrow(Arena* arena, void* pointer, size_t oldSize, size_t newSize);
+
+#define ARENA_ALLOCATE(arena, type, count) \
+    (type*)arenaAllocate(arena, sizeof(type) * (count))
+
+#define ARENA_GROW_ARRAY(arena, type, pointer, oldCount, newCount) \
+    (type*)arenaGrow(arena, pointer, sizeof(type) * (oldCount),    \
+                     sizeof(type) * (newCount))
+
+#endif
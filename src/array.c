@@ -0,0 +1,220 @@
+#include "array.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define LANES 4
+
+// four doubles worked on at once: one avx2 register, two sse2 ones or a
+// plain array that the compiler may vectorize on its own. min and max
+// are a < b ? a : b and a > b ? a : b lane by lane, which is what minpd
+// and maxpd do with nan.
+#if defined(__AVX2__)
+typedef __m256d Lanes;
+
+static inline Lanes loadLanes(const double* p) { return _mm256_loadu_pd(p); }
+static inline void storeLanes(double* p, Lanes x) { _mm256_storeu_pd(p, x); }
+static inline Lanes splatLanes(double x) { return _mm256_set1_pd(x); }
+static inline Lanes addLanes(Lanes a, Lanes b) { return _mm256_add_pd(a, b); }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return _mm256_mul_pd(a, b); }
+static inline Lanes minLanes(Lanes a, Lanes b) { return _mm256_min_pd(a, b); }
+static inline Lanes maxLanes(Lanes a, Lanes b) { return _mm256_max_pd(a, b); }
+#elif defined(__SSE2__)
+typedef struct {
+    __m128d low;
+    __m128d high;
+} Lanes;
+
+static inline Lanes loadLanes(const double* p) {
+    return (Lanes){_mm_loadu_pd(p), _mm_loadu_pd(p + 2)};
+}
+static inline void storeLanes(double* p, Lanes x) {
+    _mm_storeu_pd(p, x.low);
+    _mm_storeu_pd(p + 2, x.high);
+}
+static inline Lanes splatLanes(double x) {
+    return (Lanes){_mm_set1_pd(x), _mm_set1_pd(x)};
+}
+static inline Lanes addLanes(Lanes a, Lanes b) {
+    return (Lanes){_mm_add_pd(a.low, b.low), _mm_add_pd(a.high, b.high)};
+}
+static inline Lanes mulLanes(Lanes a, Lanes b) {
+    return (Lanes){_mm_mul_pd(a.low, b.low), _mm_mul_pd(a.high, b.high)};
+}
+static inline Lanes minLanes(Lanes a, Lanes b) {
+    return (Lanes){_mm_min_pd(a.low, b.low), _mm_min_pd(a.high, b.high)};
+}
+static inline Lanes maxLanes(Lanes a, Lanes b) {
+    return (Lanes){_mm_max_pd(a.low, b.low), _mm_max_pd(a.high, b.high)};
+}
+#else
+typedef struct {
+    double lane[LANES];
+} Lanes;
+
+static inline Lanes loadLanes(const double* p) {
+    Lanes x;
+    for (int i = 0; i < LANES; i++) x.lane[i] = p[i];
+    return x;
+}
+static inline void storeLanes(double* p, Lanes x) {
+    for (int i = 0; i < LANES; i++) p[i] = x.lane[i];
+}
+static inline Lanes splatLanes(double x) {
+    Lanes result;
+    for (int i = 0; i < LANES; i++) result.lane[i] = x;
+    return result;
+}
+static inline Lanes addLanes(Lanes a, Lanes b) {
+    for (int i = 0; i < LANES; i++) a.lane[i] += b.lane[i];
+    return a;
+}
+static inline Lanes mulLanes(Lanes a, Lanes b) {
+    for (int i = 0; i < LANES; i++) a.lane[i] *= b.lane[i];
+    return a;
+}
+static inline Lanes minLanes(Lanes a, Lanes b) {
+    for (int i = 0; i < LANES; i++) {
+        a.lane[i] = a.lane[i] < b.lane[i] ? a.lane[i] : b.lane[i];
+    }
+    return a;
+}
+static inline Lanes maxLanes(Lanes a, Lanes b) {
+    for (int i = 0; i < LANES; i++) {
+        a.lane[i] = a.lane[i] > b.lane[i] ? a.lane[i] : b.lane[i];
+    }
+    return a;
+}
+#endif
+
+static double least(double a, double b) { return a < b ? a : b; }
+static double greatest(double a, double b) { return a > b ? a : b; }
+
+double arraySum(const double* values, int count) {
+    // two sums in flight, so that each add doesn't wait on the last
+    Lanes even = splatLanes(0);
+    Lanes odd = splatLanes(0);
+    int i = 0;
+    for (; i + 2 * LANES <= count; i += 2 * LANES) {
+        even = addLanes(even, loadLanes(values + i));
+        odd = addLanes(odd, loadLanes(values + i + LANES));
+    }
+    if (i + LANES <= count) {
+        even = addLanes(even, loadLanes(values + i));
+        i += LANES;
+    }
+    double lanes[LANES];
+    storeLanes(lanes, addLanes(even, odd));
+    // the rest go into the lanes they would have gone to
+    for (; i < count; i++) lanes[i % LANES] += values[i];
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+double arrayDot(const double* a, const double* b, int count) {
+    Lanes even = splatLanes(0);
+    Lanes odd = splatLanes(0);
+    int i = 0;
+    for (; i + 2 * LANES <= count; i += 2 * LANES) {
+        even = addLanes(even, mulLanes(loadLanes(a + i), loadLanes(b + i)));
+        odd = addLanes(odd, mulLanes(loadLanes(a + i + LANES),
+                                     loadLanes(b + i + LANES)));
+    }
+    if (i + LANES <= count) {
+        even = addLanes(even, mulLanes(loadLanes(a + i), loadLanes(b + i)));
+        i += LANES;
+    }
+    double lanes[LANES];
+    storeLanes(lanes, addLanes(even, odd));
+    for (; i < count; i++) lanes[i % LANES] += a[i] * b[i];
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+void arrayScale(double* values, int count, double factor) {
+    Lanes factors = splatLanes(factor);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        storeLanes(values + i, mulLanes(loadLanes(values + i), factors));
+    }
+    for (; i < count; i++) values[i] *= factor;
+}
+
+void arrayAdd(double* a, const double* b, int count) {
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        storeLanes(a + i, addLanes(loadLanes(a + i), loadLanes(b + i)));
+    }
+    for (; i < count; i++) a[i] += b[i];
+}
+
+double arrayMin(const double* values, int count) {
+    Lanes min = splatLanes(values[0]);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        min = minLanes(loadLanes(values + i), min);
+    }
+    double lanes[LANES];
+    storeLanes(lanes, min);
+    for (; i < count; i++) {
+        lanes[i % LANES] = least(values[i], lanes[i % LANES]);
+    }
+    return least(least(lanes[0], lanes[1]), least(lanes[2], lanes[3]));
+}
+
+double arrayMax(const double* values, int count) {
+    Lanes max = splatLanes(values[0]);
+    int i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        max = maxLanes(loadLanes(values + i), max);
+    }
+    double lanes[LANES];
+    storeLanes(lanes, max);
+    for (; i < count; i++) {
+        lanes[i % LANES] = greatest(values[i], lanes[i % LANES]);
+    }
+    return greatest(greatest(lanes[0], lanes[1]),
+                    greatest(lanes[2], lanes[3]));
+}
+
+bool arraysEqual(const ObjArray* a, const ObjArray* b) {
+    if (a->count != b->count) return false;
+    for (int i = 0; i < a->count; i++) {
+        if (a->values[i] != b->values[i]) return false;
+    }
+    return true;
+}
+
+// the element of array that index names, or the error it is
+static const char* element(Value array, Value index, double** result) {
+    if (!IS_ARRAY(array)) return "Only arrays can be indexed.";
+    if (!IS_NUMBER(index)) return "Array index must be a number.";
+    ObjArray* elements = AS_ARRAY(array);
+    double number = AS_NUMBER(index);
+    // false for nan as well
+    if (!(number >= 0 && number < elements->count)) {
+        return "Array index out of bounds.";
+    }
+    int i = (int)number;
+    if (i != number) return "Array index must be a whole number.";
+    *result = &elements->values[i];
+    return NULL;
+}
+
+const char* arrayGet(Value array, Value index, Value* result) {
+    double* at;
+    const char* error = element(array, index, &at);
+    if (error != NULL) return error;
+    *result = NUMBER_VAL(*at);
+    return NULL;
+}
+
+const char* arraySet(Value array, Value index, Value value) {
+    double* at;
+    const char* error = element(array, index, &at);
+    if (error != NULL) return error;
+    if (!IS_NUMBER(value)) return "Arrays only hold numbers.";
+    *at = AS_NUMBER(value);
+    return NULL;
+}
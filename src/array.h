@@ -0,0 +1,29 @@
+#ifndef clox_array_h
+#define clox_array_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+// the bulk operations on arrays, with avx2 or sse2 kernels when the build
+// targets them and plain loops otherwise. sums and extremes are kept in
+// four interleaved lanes in every kernel and combined the same way, so
+// they don't depend on which kernel a build has.
+double arraySum(const double* values, int count);
+double arrayDot(const double* a, const double* b, int count);
+void arrayScale(double* values, int count, double factor);
+// a[i] += b[i]
+void arrayAdd(double* a, const double* b, int count);
+// count has to be at least 1
+double arrayMin(const double* values, int count);
+double arrayMax(const double* values, int count);
+// the same numbers in the same order
+bool arraysEqual(const ObjArray* a, const ObjArray* b);
+
+// *result = array[index]. NULL, or the message of the runtime error it
+// failed with.
+const char* arrayGet(Value array, Value index, Value* result);
+// array[index] = value, or the message of the runtime error
+const char* arraySet(Value array, Value index, Value value);
+
+#endif
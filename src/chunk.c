@@ -1,6 +1,7 @@
 #include "chunk.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "memory.h"
 #include "value.h"
@@ -10,6 +11,7 @@ void initChunk(Chunk* chunk) {
     chunk->count = 0;
     chunk->code = NULL;
     chunk->lines = NULL;
+    chunk->registerCode = false;
     initValueArray(&chunk->constants);
 }
 
@@ -34,7 +36,72 @@ void freeChunk(Chunk* chunk) {
     initChunk(chunk);
 }
 
+void replaceCode(Chunk* chunk, const uint8_t* code, const int* lines,
+                 int count) {
+    if (chunk->capacity < count) {
+        FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+        FREE_ARRAY(int, chunk->lines, chunk->capacity);
+        chunk->code = ALLOCATE(uint8_t, count);
+        chunk->lines = ALLOCATE(int, count);
+        chunk->capacity = count;
+    }
+    memcpy(chunk->code, code, count);
+    memcpy(chunk->lines, lines, sizeof(int) * count);
+    chunk->count = count;
+}
+
 int addConstant(Chunk* chunk, Value value) {
     writeValueArray(&chunk->constants, value);
     return chunk->constants.count - 1;
-}
\ No newline at end of file
+}
+
+bool isSuperinstruction(uint8_t instruction) {
+    return instruction > OP_LOOP && instruction <= OP_ADD_NUMBER_CONSTANT;
+}
+
+int operandLength(uint8_t instruction) {
+    switch (instruction) {
+        case OP_CONSTANT:
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_POP:
+        case OP_SET_GLOBAL_POP:
+        case OP_POPN:
+        case OP_ADD_CONSTANT:
+        case OP_LESS_CONSTANT:
+        case OP_ADD_NUMBER_CONSTANT:
+        case OP_NATIVE:
+            return 1;
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+        case OP_JUMP_IF_FALSE_POP:
+            return 2;
+        case OP_NEGATE:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_NOT:
+        case OP_RETURN:
+        case OP_PRINT:
+        case OP_POP:
+        case OP_NOT_EQUAL:
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+        case OP_ADD_NUMBER:
+        case OP_NEGATE_NUMBER:
+        case OP_GET_INDEX:
+        case OP_SET_INDEX:
+            return 0;
+    }
+    return -1;
+}
@@ -25,19 +25,85 @@ typedef enum {
     OP_SET_GLOBAL,
     OP_SET_LOCAL,
     OP_GET_LOCAL,
+    OP_JUMP_IF_FALSE,
+    OP_LOOP,
+    // superinstructions, only ever written by the peephole pass. each
+    // does what the sequence in its comment does.
+    OP_NOT_EQUAL,            // OP_EQUAL, OP_NOT
+    OP_LESS_EQUAL,           // OP_GREATER, OP_NOT
+    OP_GREATER_EQUAL,        // OP_LESS, OP_NOT
+    OP_SET_LOCAL_POP,        // OP_SET_LOCAL slot, OP_POP
+    OP_SET_GLOBAL_POP,       // OP_SET_GLOBAL constant, OP_POP
+    OP_POPN,                 // OP_POP, n times
+    OP_JUMP_IF_FALSE_POP,    // OP_JUMP_IF_FALSE offset, OP_POP
+    OP_ADD_CONSTANT,         // OP_CONSTANT constant, OP_ADD
+    OP_LESS_CONSTANT,        // OP_CONSTANT constant, OP_LESS
+    OP_ADD_NUMBER_CONSTANT,  // OP_CONSTANT constant, OP_ADD_NUMBER
+    // unchecked forms of OP_ADD and OP_NEGATE, written by the optimizer
+    // where type inference proved the operands are numbers
+    OP_ADD_NUMBER,
+    OP_NEGATE_NUMBER,
+    // arrays, see array.h
+    OP_GET_INDEX,  // array, index -> array[index]
+    OP_SET_INDEX,  // array, index, value -> value, stored in array[index]
+    // calls the native named by its operand on the arguments on top of
+    // the stack, see natives.h
+    OP_NATIVE,
 } OpCode;
 
+// the register encoding, see registers.h. every instruction is four
+// bytes: the opcode and operands a, b and c, which name slots of the vm
+// stack unless noted. numbered apart from OpCode so that counters and
+// names can tell the two sets apart.
+typedef enum {
+    REG_MOVE = 64,      // a = b
+    REG_LOAD_CONSTANT,  // a = constant b
+    REG_NIL,            // a = nil
+    REG_TRUE,           // a = true
+    REG_FALSE,          // a = false
+    REG_EQUAL,          // a = b op c
+    REG_LESS,
+    REG_GREATER,
+    REG_ADD,
+    REG_SUBTRACT,
+    REG_MULTIPLY,
+    REG_DIVIDE,
+    REG_NEGATE,         // a = op b
+    REG_NOT,
+    REG_PRINT,          // print a
+    REG_DEFINE_GLOBAL,  // global named by constant b = a
+    REG_GET_GLOBAL,     // a = global named by constant b
+    REG_SET_GLOBAL,     // global named by constant b = a
+    REG_JUMP_IF_FALSE,  // skip bc bytes forward if a is falsey
+    REG_LOOP,           // go bc bytes back
+    REG_RETURN,
+    REG_ADD_NUMBER,     // unchecked REG_ADD and REG_NEGATE
+    REG_NEGATE_NUMBER,
+} RegisterOpCode;
+
+#define REGISTER_INSTRUCTION_SIZE 4
+
 typedef struct {
     int count;
     int capacity;
     uint8_t* code;
     int* lines;
     ValueArray constants;
+    // code holds the register encoding instead of the stack one
+    bool registerCode;
 } Chunk;
 
 void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 int addConstant(Chunk* chunk, Value value);
+// replaces the code and line table of chunk with count bytes of the
+// given ones, growing it only if they don't fit
+void replaceCode(Chunk* chunk, const uint8_t* code, const int* lines,
+                 int count);
+// the operand bytes following a stack opcode, -1 if it isn't one
+int operandLength(uint8_t instruction);
+// written by the peephole pass, see above
+bool isSuperinstruction(uint8_t instruction);
 
 #endif
\ No newline at end of file
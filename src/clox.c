@@ -0,0 +1,82 @@
+#include "clox.h"
+
+#include <string.h>
+
+#include "compiler.h"
+#include "intern.h"
+#include "memory.h"
+#include "object.h"
+#include "program.h"
+
+VM* cloxNewVM() {
+    VM* vm = ALLOCATE(VM, 1);
+    initVM(vm);
+    return vm;
+}
+
+void cloxFreeVM(VM* vm) {
+    freeVM(vm);
+    FREE(VM, vm);
+}
+
+void cloxSetOutput(VM* vm, FILE* file) {
+    flushOutput(&vm->output);
+    initOutput(&vm->output, file);
+}
+
+void cloxSetStackSize(VM* vm, size_t size) { setStackSize(vm, size); }
+
+Program* cloxCompile(const char* source) {
+    Program* program = ALLOCATE(Program, 1);
+    if (!compileProgram(program, source, stderr)) {
+        FREE(Program, program);
+        return NULL;
+    }
+    return program;
+}
+
+void cloxBindProgram(VM* vm, const Program* program) {
+    bindProgram(vm, program);
+}
+
+InterpretResult cloxRun(VM* vm, const Program* program) {
+    return interpretProgram(vm, program);
+}
+
+void cloxFreeProgram(Program* program) {
+    if (program == NULL) return;
+    freeProgram(program);
+    FREE(Program, program);
+}
+
+void cloxFreeCompileContext() { freeProgramContext(); }
+
+void cloxFreeSharedStrings() { freeSharedStrings(); }
+
+void cloxSetOptLevel(VM* vm, int level) { vm->optLevel = level; }
+
+InterpretResult cloxInterpret(VM* vm, const char* source) {
+    return interpret(vm, source);
+}
+
+void cloxSetBudget(VM* vm, uint64_t instructions, uint64_t nanos) {
+    setBudget(vm, (Budget){instructions, nanos});
+}
+
+InterpretResult cloxResume(VM* vm) { return resumeVM(vm); }
+
+bool cloxGetGlobal(VM* vm, const char* name, Value* value) {
+    ObjString* key = copyString(vm, name, (int)strlen(name));
+    return mapGet(&vm->globals, key, value);
+}
+
+void cloxSetGlobal(VM* vm, const char* name, Value value) {
+    ObjString* key = copyString(vm, name, (int)strlen(name));
+    mapSet(&vm->globals, key, value);
+}
+
+Value cloxString(VM* vm, const char* chars, int length) {
+    return OBJ_VAL(copyString(vm, chars, length));
+}
+
+void cloxGetStats(VM* vm, VMStats* stats) { getVMStats(vm, stats); }
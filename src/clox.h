@@ -0,0 +1,64 @@
+#ifndef clox_h
+#define clox_h
+
+// the embedding api. every call works on the vm it is given: separate
+// vms share no state and can be used from different threads at the same
+// time, a single vm can't.
+
+#include <stdio.h>
+
+#include "stats.h"
+#include "value.h"
+#include "vm.h"
+
+// a compiled, immutable script. any number of vms on any threads can
+// run it at the same time. its strings are interned once for the whole
+// process and stay alive until cloxFreeSharedStrings().
+typedef struct Program Program;
+
+VM* cloxNewVM();
+void cloxFreeVM(VM* vm);
+// where print writes to, stdout by default
+void cloxSetOutput(VM* vm, FILE* file);
+// how many values the vm's stack holds at least, STACK_DEFAULT_SIZE
+// unless set, rounded up to whole pages. pushing more is a runtime
+// error, and only the part a script uses takes up memory.
+void cloxSetStackSize(VM* vm, size_t size);
+
+// returns NULL if the source has compile errors, they go to stderr.
+// what the compiler works in is kept for the next call on the same
+// thread, until cloxFreeCompileContext().
+Program* cloxCompile(const char* source);
+// a vm runs one program at a time and starts from a clean state when it
+// switches. bind it before setting globals for a program, cloxRun()
+// binds it otherwise.
+void cloxBindProgram(VM* vm, const Program* program);
+InterpretResult cloxRun(VM* vm, const Program* program);
+// no vm may run the program any more
+void cloxFreeProgram(Program* program);
+// frees what cloxCompile() kept on the calling thread. a thread that
+// compiled calls it before it exits.
+void cloxFreeCompileContext();
+// frees the strings of every program compiled so far. call it last,
+// once no vm or program is left.
+void cloxFreeSharedStrings();
+// how hard cloxInterpret() optimizes the scripts it compiles,
+// OPT_LEVEL_NONE by default. cloxCompile() leaves programs unoptimized.
+void cloxSetOptLevel(VM* vm, int level);
+InterpretResult cloxInterpret(VM* vm, const char* source);
+// bounds the runs that follow by instructions executed and wall-clock
+// time, 0 for no limit. a run over budget stops at its next loop
+// iteration with INTERPRET_BUDGET_EXHAUSTED. cloxResume() carries on a
+// cloxRun() stopped that way, after a new cloxSetBudget() if it needs
+// more. binding another program clears the budget.
+void cloxSetBudget(VM* vm, uint64_t instructions, uint64_t nanos);
+InterpretResult cloxResume(VM* vm);
+
+bool cloxGetGlobal(VM* vm, const char* name, Value* value);
+void cloxSetGlobal(VM* vm, const char* name, Value value);
+// a string owned by vm, e.g. to pass to cloxSetGlobal()
+Value cloxString(VM* vm, const char* chars, int length);
+
+void cloxGetStats(VM* vm, VMStats* stats);
+
+#endif
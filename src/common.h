@@ -4,7 +4,24 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// optimized builds (-c opt defines NDEBUG) run quietly
+#ifndef NDEBUG
 #define DEBUG_PRINT_CODE
 #define DEBUG_TRACE_EXECUTION
+#endif
+// tokenize the whole source before parsing instead of scanning on demand
+// #define BATCH_TOKENIZE
+// count and time every opcode, see profiler.h
+// #define PROFILE_OPCODES
+// leave out the peephole pass and its superinstructions, see peephole.h
+// #define DISABLE_PEEPHOLE
+// translate compiled code to the register encoding, see registers.h
+// #define REGISTER_VM
+// run hot loops as x86-64 machine code, see jit.h. tracing and the opcode
+// profiler only see the interpreter, so they turn it off.
+#if defined(__x86_64__) && !defined(DEBUG_TRACE_EXECUTION) && \
+    !defined(PROFILE_OPCODES)
+#define ENABLE_JIT
+#endif
 #define UINT8_COUNT (UINT8_MAX + 1)
 #endif
\ No newline at end of file
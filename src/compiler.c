@@ -5,19 +5,69 @@
 #include <string.h>
 
 #include "common.h"
+#include "memory.h"
+#include "natives.h"
+#include "number.h"
 #include "object.h"
+#include "optimize.h"
+#include "peephole.h"
+#include "probes.h"
+#include "registers.h"
 #include "scanner.h"
 #include "value.h"
+#include "vm.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
 #endif
 
+// an identifier the compiler has seen, one for each distinct name, so
+// that locals are found by a single lookup instead of comparing names
+typedef struct {
+    const char* start;
+    int length;
+    uint32_t hash;
+    // the innermost local with this name, -1 if there is none
+    int local;
+} Name;
+
+typedef struct {
+    Name* name;
+    int depth;
+    // the local of the same name this one shadows, put back when it goes
+    // out of scope. popping a scope's locals undoes its declarations.
+    int shadowed;
+} Local;
+
+typedef struct {
+    Local locals[UINT8_COUNT];
+    int localCount;
+    int scopeDepth;
+    // open addressed by the hash of the name's text, in the arena
+    Name** names;
+    int nameCount;
+    int nameCapacity;
+} Compiler;
+
+// everything a single compilation touches, so that separate vms can
+// compile at the same time
 typedef struct {
     Token current;
     Token previous;
     bool hadError;
     bool panicMode;
+    Scanner* scanner;
+    // set when parsing from a pre-tokenized source instead of pulling
+    // tokens from the scanner
+    TokenBuffer* tokens;
+    int nextToken;
+    int lineRun;
+    Compiler* compiler;
+    // the context's scratch chunk
+    Chunk* chunk;
+    Arena* arena;
+    // strings are interned in this vm
+    VM* vm;
 } Parser;
 
 typedef enum {
@@ -34,49 +84,47 @@ typedef enum {
     PREC_PRIMARY
 } Precedence;
 
-typedef void (*ParseFn)(bool canAssign);
+typedef void (*ParseFn)(Parser* parser, bool canAssign);
 typedef struct {
     ParseFn prefix;
     ParseFn infix;
     Precedence precedence;
 } ParseRule;
 
-typedef struct {
-    Token name;
-    int depth;
-} Local;
-
-typedef struct {
-    Local locals[UINT8_COUNT];
-    int localCount;
-    int scopeDepth;
-} Compiler;
-
-Parser parser;
-Compiler* current = NULL;
-Chunk* compilingChunk;
+static Chunk* currentChunk(Parser* parser) { return parser->chunk; }
 
-static Chunk* currentChunk() { return compilingChunk; }
+static Token nextToken(Parser* parser) {
+    if (parser->tokens == NULL) {
+        return scanToken(parser->scanner);
+    }
+    Token token =
+        tokenAt(parser->tokens, parser->nextToken, &parser->lineRun);
+    // the trailing EOF is handed out again if the parser keeps asking
+    if (parser->nextToken < parser->tokens->count - 1) {
+        parser->nextToken++;
+    }
+    return token;
+}
 
-static void advance() {
-    parser.previous = parser.current;
+static void advance(Parser* parser) {
+    parser->previous = parser->current;
     for (;;) {
-        parser.current = scanToken();
-        if (parser.current.type != TOKEN_ERROR) break;
+        parser->current = nextToken(parser);
+        if (parser->current.type != TOKEN_ERROR) break;
     }
 }
 
-static void emitByte(uint8_t byte) {
-    writeChunk(currentChunk(), byte, parser.previous.line);
+static void emitByte(Parser* parser, uint8_t byte) {
+    writeChunk(currentChunk(parser), byte, parser->previous.line);
 }
 
-static void emitBytes(uint8_t b1, uint8_t b2) {
-    emitByte(b1);
-    emitByte(b2);
+static void emitBytes(Parser* parser, uint8_t b1, uint8_t b2) {
+    emitByte(parser, b1);
+    emitByte(parser, b2);
 }
 
-static uint8_t makeConstant(Value value) {
-    int constant = addConstant(currentChunk(), value);
+static uint8_t makeConstant(Parser* parser, Value value) {
+    int constant = addConstant(currentChunk(parser), value);
     if (constant > UINT8_MAX) {
         // error()
         return 0;
@@ -84,280 +132,423 @@ static uint8_t makeConstant(Value value) {
     return (uint8_t)constant;
 }
 
-static void emitConstant(Value value) {
-    emitBytes(OP_CONSTANT, makeConstant(value));
+static void error(Parser* parser, const char* message);
+
+static int emitJump(Parser* parser, uint8_t instruction) {
+    emitByte(parser, instruction);
+    emitByte(parser, 0xff);
+    emitByte(parser, 0xff);
+    return currentChunk(parser)->count - 2;
 }
 
-static void initCompiler(Compiler* compiler) {
+static void patchJump(Parser* parser, int offset) {
+    // -2 to skip over the jump offset itself
+    int jump = currentChunk(parser)->count - offset - 2;
+    if (jump > UINT16_MAX) {
+        error(parser, "Too much code to jump over.");
+    }
+    currentChunk(parser)->code[offset] = (jump >> 8) & 0xff;
+    currentChunk(parser)->code[offset + 1] = jump & 0xff;
+}
+
+static void emitLoop(Parser* parser, int loopStart) {
+    emitByte(parser, OP_LOOP);
+    int offset = currentChunk(parser)->count - loopStart + 2;
+    if (offset > UINT16_MAX) {
+        error(parser, "Loop body too large.");
+    }
+    emitByte(parser, (offset >> 8) & 0xff);
+    emitByte(parser, offset & 0xff);
+}
+
+static void emitConstant(Parser* parser, Value value) {
+    emitBytes(parser, OP_CONSTANT, makeConstant(parser, value));
+}
+
+static void initCompiler(Parser* parser, Compiler* compiler) {
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
-    current = compiler;
+    compiler->names = NULL;
+    compiler->nameCount = 0;
+    compiler->nameCapacity = 0;
+    parser->compiler = compiler;
 }
 
-static void number(bool canAssign) {
-    double value = strtod(parser.previous.start, NULL);
-    emitConstant(NUMBER_VAL(value));
+static void number(Parser* parser, bool canAssign) {
+    double value = parseNumber(parser->previous.start, parser->previous.length);
+    emitConstant(parser, NUMBER_VAL(value));
 }
 
-static void errorAtCurrent(const char* message) {
-    printf("Error %s\n", message);
-    parser.hadError = true;
-    parser.panicMode = true;
+static void errorAtCurrent(Parser* parser, const char* message) {
+    fprintf(parser->vm->errorFile, "Error %s\n", message);
+    parser->hadError = true;
+    parser->panicMode = true;
 }
 
-static void consume(TokenType type, const char* message) {
-    if (parser.current.type == type) {
-        advance();
+static void consume(Parser* parser, TokenType type, const char* message) {
+    if (parser->current.type == type) {
+        advance(parser);
         return;
     }
-    printf("should had token %d but instead found %d (%.*s)\n", type,
-           parser.current.type, parser.current.length, parser.current.start);
-    errorAtCurrent(message);
+    fprintf(parser->vm->errorFile,
+            "should had token %d but instead found %d (%.*s)\n", type,
+            parser->current.type, parser->current.length,
+            parser->current.start);
+    errorAtCurrent(parser, message);
 }
 
-static bool check(TokenType type) { return parser.current.type == type; }
+static bool check(Parser* parser, TokenType type) {
+    return parser->current.type == type;
+}
 
-static bool match(TokenType type) {
-    if (!check(type)) {
+static bool match(Parser* parser, TokenType type) {
+    if (!check(parser, type)) {
         return false;
     }
-    advance();
+    advance(parser);
 
     return true;
 }
 
-static void expression();
+static void expression(Parser* parser);
 static ParseRule* getRule(TokenType type);
 
-void emitReturn() { emitByte(OP_RETURN); }
-void endCompiler() {
-    emitReturn();
+void emitReturn(Parser* parser) { emitByte(parser, OP_RETURN); }
+void endCompiler(Parser* parser) {
+    emitReturn(parser);
+    if (!parser->hadError && parser->vm->optLevel >= OPT_LEVEL_IR) {
+        optimizeCode(currentChunk(parser), parser->arena);
+    }
+#ifdef REGISTER_VM
+    if (!parser->hadError) {
+        translateToRegisters(currentChunk(parser), parser->arena);
+    }
+#endif
+#ifndef DISABLE_PEEPHOLE
+    if (!parser->hadError) optimizeChunk(currentChunk(parser), parser->arena);
+#endif
 #ifdef DEBUG_PRINT_CODE
-    if (!parser.hadError) {
-        disassembleChunk(currentChunk(), "code");
+    if (!parser->hadError) {
+        disassembleChunk(currentChunk(parser), "code");
     }
 #endif
 }
 
-static void error(const char* message) {
-    parser.hadError = true;
-    printf("%s\n", message);
+static void error(Parser* parser, const char* message) {
+    parser->hadError = true;
+    fprintf(parser->vm->errorFile, "%s\n", message);
 }
 
-static void parsePrecedence(Precedence precedence) {
-    advance();
+static void parsePrecedence(Parser* parser, Precedence precedence) {
+    advance(parser);
 
-    ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+    ParseFn prefixRule = getRule(parser->previous.type)->prefix;
     if (prefixRule == NULL) {
-        error("Expected expression.");
+        error(parser, "Expected expression.");
         return;
     }
 
     bool canAssign = precedence <= PREC_ASSIGNMENT;
-    prefixRule(canAssign);
+    prefixRule(parser, canAssign);
 
     // get the rule for the current token
     // if the rule precedence is higher that the current precedence
     // parse the infix rule
-    while (precedence < getRule(parser.current.type)->precedence) {
-        advance();
-        ParseFn infixRule = getRule(parser.previous.type)->infix;
-        infixRule(canAssign);
+    while (precedence <= getRule(parser->current.type)->precedence) {
+        advance(parser);
+        ParseFn infixRule = getRule(parser->previous.type)->infix;
+        infixRule(parser, canAssign);
     }
-    if (canAssign && match(TOKEN_EQUAL)) {
-        error("Invalid assignment target.");
+    if (canAssign && match(parser, TOKEN_EQUAL)) {
+        error(parser, "Invalid assignment target.");
     }
 }
 
-static uint8_t identifierConstant(Token* name) {
-    return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+// a string of source text, copied out of it unless the vm borrows it
+static ObjString* sourceString(Parser* parser, const char* chars,
+                               int length) {
+    if (parser->vm->borrowSource) {
+        return borrowString(parser->vm, chars, length);
+    }
+    return copyString(parser->vm, chars, length);
 }
 
-static bool identifiersEqual(Token* a, Token* b) {
-    if (a->length != b->length) {
-        return false;
+static uint8_t identifierConstant(Parser* parser, Token* name) {
+    ObjString* string = sourceString(parser, name->start, name->length);
+    return makeConstant(parser, OBJ_VAL(string));
+}
+
+static Name** findSlot(Name** names, int capacity, const char* start,
+                       int length, uint32_t hash) {
+    uint32_t index = hash & (capacity - 1);
+    for (;;) {
+        Name* name = names[index];
+        if (name == NULL ||
+            (name->hash == hash && name->length == length &&
+             memcmp(name->start, start, length) == 0)) {
+            return &names[index];
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static void growNames(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    int capacity = GROW_CAPACITY(compiler->nameCapacity);
+    Name** names = ARENA_ALLOCATE(parser->arena, Name*, capacity);
+    for (int i = 0; i < capacity; i++) names[i] = NULL;
+    for (int i = 0; i < compiler->nameCapacity; i++) {
+        Name* name = compiler->names[i];
+        if (name == NULL) continue;
+        *findSlot(names, capacity, name->start, name->length, name->hash) =
+            name;
     }
-    return memcmp(a->start, b->start, a->length) == 0;
+    compiler->names = names;
+    compiler->nameCapacity = capacity;
 }
 
-static void addLocal(Token token) {
-    if (current->localCount == UINT8_COUNT) {
-        error("Too many local variables in function");
+// the name of an identifier, added the first time it is seen
+static Name* findName(Parser* parser, Token* token) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->nameCount + 1 > compiler->nameCapacity * 3 / 4) {
+        growNames(parser);
+    }
+    uint32_t hash = hashString(token->start, token->length);
+    Name** slot = findSlot(compiler->names, compiler->nameCapacity,
+                           token->start, token->length, hash);
+    if (*slot == NULL) {
+        Name* name = ARENA_ALLOCATE(parser->arena, Name, 1);
+        name->start = token->start;
+        name->length = token->length;
+        name->hash = hash;
+        name->local = -1;
+        *slot = name;
+        compiler->nameCount++;
+    }
+    return *slot;
+}
+
+static void addLocal(Parser* parser, Name* name) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->localCount == UINT8_COUNT) {
+        error(parser, "Too many local variables in function");
         return;
     }
-    Local* local = &current->locals[current->localCount];
-    current->localCount++;
-    local->name = token;
-    local->depth = current->scopeDepth;
+    Local* local = &compiler->locals[compiler->localCount];
+    local->name = name;
+    local->depth = compiler->scopeDepth;
+    local->shadowed = name->local;
+    name->local = compiler->localCount;
+    compiler->localCount++;
 }
 
-static void declareVariable() {
-    if (current->scopeDepth == 0) {
+static void declareVariable(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    if (compiler->scopeDepth == 0) {
         return;
     }
-    Token* name = &parser.previous;
+    Name* name = findName(parser, &parser->previous);
     // check for double declarations
-    for (int i = current->localCount - 1; i >= 0; i--) {
-        Local* local = &current->locals[i];
-        if (local->depth != -1 && local->depth < current->scopeDepth) {
-            break;
-        }
-        if (identifiersEqual(name, &local->name)) {
-            error("Already a variable with this name in the scope.");
-        }
+    if (name->local >= 0 &&
+        compiler->locals[name->local].depth == compiler->scopeDepth) {
+        error(parser, "Already a variable with this name in the scope.");
     }
-    addLocal(*name);
+    addLocal(parser, name);
 }
 
-static uint8_t parseVariable(const char* errorMessage) {
-    consume(TOKEN_IDENTIFIER, errorMessage);
-    declareVariable();
-    if (current->scopeDepth > 0) {
+static uint8_t parseVariable(Parser* parser, const char* errorMessage) {
+    consume(parser, TOKEN_IDENTIFIER, errorMessage);
+    declareVariable(parser);
+    if (parser->compiler->scopeDepth > 0) {
         return;
     }
-    return identifierConstant(&parser.previous);
+    return identifierConstant(parser, &parser->previous);
 }
 
-static void defineVariable(uint8_t global) {
-    if (current->scopeDepth > 0) {
+static void defineVariable(Parser* parser, uint8_t global) {
+    if (parser->compiler->scopeDepth > 0) {
         return;
     }
-    emitBytes(OP_DEFINE_GLOBAL, global);
+    emitBytes(parser, OP_DEFINE_GLOBAL, global);
 }
 
-static void expression() { parsePrecedence(PREC_ASSIGNMENT); }
-static void varDeclaration() {
-    uint8_t global = parseVariable("Expect variable name.");
-    if (match(TOKEN_EQUAL)) {
-        expression();
+static void expression(Parser* parser) {
+    parsePrecedence(parser, PREC_ASSIGNMENT);
+}
+static void varDeclaration(Parser* parser) {
+    uint8_t global = parseVariable(parser, "Expect variable name.");
+    if (match(parser, TOKEN_EQUAL)) {
+        expression(parser);
     } else {
-        emitByte(OP_NIL);
+        emitByte(parser, OP_NIL);
     }
-    consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration");
-    defineVariable(global);
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after variable declaration");
+    defineVariable(parser, global);
 }
 
-static void statement();
-static void declaration();
-static void grouping(bool canAssign) {
-    expression();
-    consume(TOKEN_RIGHT_PAREN, "Expected ') after expression.");
+static void statement(Parser* parser);
+static void declaration(Parser* parser);
+static void grouping(Parser* parser, bool canAssign) {
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, "Expected ') after expression.");
 }
 
-static void unary(bool canAssign) {
-    TokenType operatorType = parser.previous.type;
-    expression();
+static void unary(Parser* parser, bool canAssign) {
+    TokenType operatorType = parser->previous.type;
+    parsePrecedence(parser, PREC_UNARY);
     switch (operatorType) {
         case TOKEN_MINUS:
-            emitByte(OP_NEGATE);
+            emitByte(parser, OP_NEGATE);
             break;
         case TOKEN_BANG:
-            emitByte(OP_NOT);
+            emitByte(parser, OP_NOT);
         default:
             break;
     }
 }
 
-static void string(bool canAssign) {
-    char* stringStart = parser.previous.start + 1;
-    int stringLength = parser.previous.length - 2;
-    emitConstant(OBJ_VAL(copyString(stringStart, stringLength)));
+static void string(Parser* parser, bool canAssign) {
+    char* stringStart = parser->previous.start + 1;
+    int stringLength = parser->previous.length - 2;
+    ObjString* string = sourceString(parser, stringStart, stringLength);
+    emitConstant(parser, OBJ_VAL(string));
 }
 
-static int resolveLocal(Compiler* compiler, Token* name) {
-    for (int i = compiler->localCount - 1; i >= 0; i--) {
-        Local* local = &compiler->locals[i];
-        if (identifiersEqual(name, &local->name)) {
-            return i;
-        }
-    }
-    return -1;
+static int resolveLocal(Parser* parser, Token* name) {
+    if (parser->compiler->localCount == 0) return -1;
+    return findName(parser, name)->local;
 }
 
-static void namedVariable(Token name, bool canAssign) {
-    printf("parsed named variable (canAssign = %d)\n", canAssign);
+static void namedVariable(Parser* parser, Token name, bool canAssign) {
     uint8_t getOp, setOp;
-    int arg = resolveLocal(current, &name);
+    int arg = resolveLocal(parser, &name);
     if (arg != -1) {
         getOp = OP_GET_LOCAL;
         setOp = OP_SET_LOCAL;
     } else {
-        arg = identifierConstant(&name);
+        arg = identifierConstant(parser, &name);
         getOp = OP_GET_GLOBAL;
         setOp = OP_SET_GLOBAL;
     };
 
-    if (canAssign && match(TOKEN_EQUAL)) {
-        printf("parsing right side of assignment");
-        expression();
-        emitBytes(setOp, (uint8_t)arg);
+    if (canAssign && match(parser, TOKEN_EQUAL)) {
+        expression(parser);
+        emitBytes(parser, setOp, (uint8_t)arg);
+    } else {
+        emitBytes(parser, getOp, (uint8_t)arg);
+    }
+}
+
+// name(arguments). there are no functions yet, so only natives can be
+// called and the call is bound to one here
+static void nativeCall(Parser* parser, Token name) {
+    int native = findNative(name.start, name.length);
+    advance(parser);
+    int argCount = 0;
+    if (!check(parser, TOKEN_RIGHT_PAREN)) {
+        do {
+            expression(parser);
+            argCount++;
+        } while (match(parser, TOKEN_COMMA));
+    }
+    consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after arguments.");
+
+    char message[128];
+    if (native < 0) {
+        snprintf(message, sizeof(message), "Undefined function '%.*s'.",
+                 name.length, name.start);
+        error(parser, message);
+    } else if (argCount != natives[native].arity) {
+        snprintf(message, sizeof(message),
+                 "Expected %d arguments but got %d.", natives[native].arity,
+                 argCount);
+        error(parser, message);
     } else {
-        emitBytes(getOp, (uint8_t)arg);
+        emitBytes(parser, OP_NATIVE, (uint8_t)native);
+    }
+}
+
+static void variable(Parser* parser, bool canAssign) {
+    if (check(parser, TOKEN_LEFT_PAREN)) {
+        nativeCall(parser, parser->previous);
+        return;
     }
+    namedVariable(parser, parser->previous, canAssign);
 }
 
-static void variable(bool canAssign) {
-    namedVariable(parser.previous, canAssign);
+// array[index], or array[index] = value
+static void subscript(Parser* parser, bool canAssign) {
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_BRACKET, "Expected ']' after index.");
+    if (canAssign && match(parser, TOKEN_EQUAL)) {
+        expression(parser);
+        emitByte(parser, OP_SET_INDEX);
+    } else {
+        emitByte(parser, OP_GET_INDEX);
+    }
 }
 
-static void binary(bool canAssign) {
-    TokenType operatorType = parser.previous.type;
+static void binary(Parser* parser, bool canAssign) {
+    TokenType operatorType = parser->previous.type;
     ParseRule* rule = getRule(operatorType);
-    parsePrecedence((Precedence)(rule->precedence + 1));
+    parsePrecedence(parser, (Precedence)(rule->precedence + 1));
     switch (operatorType) {
         case TOKEN_PLUS:
-            emitByte(OP_ADD);
+            emitByte(parser, OP_ADD);
             break;
         case TOKEN_MINUS:
-            emitByte(OP_SUBTRACT);
+            emitByte(parser, OP_SUBTRACT);
             break;
         case TOKEN_SLASH:
-            emitByte(OP_DIVIDE);
+            emitByte(parser, OP_DIVIDE);
             break;
         case TOKEN_STAR:
-            emitByte(OP_MULTIPLY);
+            emitByte(parser, OP_MULTIPLY);
             break;
         case TOKEN_LESS:
-            emitByte(OP_LESS);
+            emitByte(parser, OP_LESS);
             break;
         case TOKEN_BANG_EQUAL:
-            emitBytes(OP_EQUAL, OP_NOT);
+            emitBytes(parser, OP_EQUAL, OP_NOT);
             break;
         case TOKEN_EQUAL_EQUAL:
-            emitByte(OP_EQUAL);
+            emitByte(parser, OP_EQUAL);
             break;
         case TOKEN_LESS_EQUAL:
-            emitBytes(OP_GREATER, OP_NOT);
+            emitBytes(parser, OP_GREATER, OP_NOT);
             break;
         case TOKEN_GREATER:
-            emitByte(OP_GREATER);
+            emitByte(parser, OP_GREATER);
             break;
         case TOKEN_GREATER_EQUAL:
-            emitBytes(OP_LESS, OP_NOT);
+            emitBytes(parser, OP_LESS, OP_NOT);
             break;
         default:
             return;
     }
 }
 
-void literal(bool canAssign) {
-    switch (parser.previous.type) {
+void literal(Parser* parser, bool canAssign) {
+    switch (parser->previous.type) {
         case TOKEN_FALSE:
-            return emitByte(OP_FALSE);
+            return emitByte(parser, OP_FALSE);
 
         case TOKEN_TRUE:
-            return emitByte(OP_TRUE);
+            return emitByte(parser, OP_TRUE);
         case TOKEN_NIL:
-            return emitByte(OP_NIL);
+            return emitByte(parser, OP_NIL);
+        default:
+            return;
     }
 }
 
 ParseRule rules[] = {
     [TOKEN_LEFT_PAREN] = {grouping, NULL, PREC_NONE},
-    [TOKEN_SLASH] = {NULL, binary, PREC_NONE},
+    [TOKEN_SLASH] = {NULL, binary, PREC_FACTOR},
     [TOKEN_MINUS] = {unary, binary, PREC_TERM},
     [TOKEN_PLUS] = {NULL, binary, PREC_TERM},
     [TOKEN_STAR] = {NULL, binary, PREC_FACTOR},
+    [TOKEN_LEFT_BRACKET] = {NULL, subscript, PREC_CALL},
     [TOKEN_NUMBER] = {number, NULL, PREC_NONE},
     [TOKEN_BANG] = {unary, NULL, PREC_NONE},
     [TOKEN_BANG_EQUAL] = {NULL, binary, PREC_EQUALITY},
@@ -380,56 +571,76 @@ ParseRule rules[] = {
 
 static ParseRule* getRule(TokenType tokenType) { return &rules[tokenType]; }
 
-static void printStatement() {
-    expression();
-    consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
-    emitByte(OP_PRINT);
+static void printStatement(Parser* parser) {
+    expression(parser);
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after expression.");
+    emitByte(parser, OP_PRINT);
 }
 
-static void expressionStatement() {
-    expression();
-    consume(TOKEN_SEMICOLON, "Expect ';' after value.");
-    emitByte(OP_POP);
+static void expressionStatement(Parser* parser) {
+    expression(parser);
+    consume(parser, TOKEN_SEMICOLON, "Expect ';' after value.");
+    emitByte(parser, OP_POP);
 }
 
-static void block() {
-    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-        declaration();
+static void block(Parser* parser) {
+    while (!check(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF)) {
+        declaration(parser);
     }
-    consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+    consume(parser, TOKEN_RIGHT_BRACE, "Expect '}' after block.");
 }
 
-static void beginScope() { current->scopeDepth++; }
-static void endScope() {
-    current->scopeDepth--;
+static void beginScope(Parser* parser) { parser->compiler->scopeDepth++; }
+static void endScope(Parser* parser) {
+    Compiler* compiler = parser->compiler;
+    compiler->scopeDepth--;
 
-    while (current->localCount > 0 &&
-           current->locals[current->localCount - 1].depth >
-               current->scopeDepth) {
-        emitByte(OP_POP);
-        current->localCount--;
+    while (compiler->localCount > 0 &&
+           compiler->locals[compiler->localCount - 1].depth >
+               compiler->scopeDepth) {
+        emitByte(parser, OP_POP);
+        compiler->localCount--;
+        Local* local = &compiler->locals[compiler->localCount];
+        local->name->local = local->shadowed;
     }
 }
 
-static void statement() {
-    if (match(TOKEN_PRINT)) {
-        printStatement();
-    } else if (match(TOKEN_LEFT_BRACE)) {
-        beginScope();
-        block();
-        endScope();
+static void whileStatement(Parser* parser) {
+    int loopStart = currentChunk(parser)->count;
+    consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
+
+    int exitJump = emitJump(parser, OP_JUMP_IF_FALSE);
+    emitByte(parser, OP_POP);
+    statement(parser);
+    emitLoop(parser, loopStart);
+
+    patchJump(parser, exitJump);
+    emitByte(parser, OP_POP);
+}
+
+static void statement(Parser* parser) {
+    if (match(parser, TOKEN_PRINT)) {
+        printStatement(parser);
+    } else if (match(parser, TOKEN_WHILE)) {
+        whileStatement(parser);
+    } else if (match(parser, TOKEN_LEFT_BRACE)) {
+        beginScope(parser);
+        block(parser);
+        endScope(parser);
     } else {
-        expressionStatement();
+        expressionStatement(parser);
     }
 }
 
-void synchronize() {
-    parser.panicMode = false;
-    while (parser.current.type != TOKEN_EOF) {
-        if (parser.previous.type == TOKEN_SEMICOLON) {
+void synchronize(Parser* parser) {
+    parser->panicMode = false;
+    while (parser->current.type != TOKEN_EOF) {
+        if (parser->previous.type == TOKEN_SEMICOLON) {
             return;
         }
-        switch (parser.current.type) {
+        switch (parser->current.type) {
             case TOKEN_CLASS:
             case TOKEN_FUN:
             case TOKEN_FOR:
@@ -442,47 +653,116 @@ void synchronize() {
                 ;  // do nothing
             }
         }
-        advance();
+        advance(parser);
     }
 }
 
-static void declaration() {
-    if (match(TOKEN_VAR)) {
-        varDeclaration();
+static void declaration(Parser* parser) {
+    if (match(parser, TOKEN_VAR)) {
+        varDeclaration(parser);
     } else {
-        statement();
+        statement(parser);
     }
 
-    if (parser.panicMode) {
-        synchronize();
+    if (parser->panicMode) {
+        synchronize(parser);
     }
 };
 
-bool compile(const char* source, Chunk* chunk) {
-    parser.hadError = false;
-    initScanner(source);
-    Compiler compiler;
-    initCompiler(&compiler);
-    compilingChunk = chunk;
-    advance();
-    while (!match(TOKEN_EOF)) {
-        declaration();
-    }
-    // int line = -1;
-    // for (;;) {
-    //     Token token = scanToken();
-    //     if (token.line != line) {
-    //         printf("%4d ", token.line);
-    //         line = token.line;
-    //     } else {
-    //         printf("   | ");
-    //     }
-    //     printf("%2d '%.*s'\n", token.type, token.length, token.start);
-    //     if (token.type == TOKEN_EOF) {
-    //         break;
-    //     }
-    // }
-    // consume(TOKEN_EOF, "Expect end of expression.");
-    endCompiler();
-    return !parser.hadError;
+void initCompileContext(CompileContext* context) {
+    initArena(&context->arena);
+    initChunk(&context->scratch);
+    initTokenBuffer(&context->tokens);
+}
+
+void freeCompileContext(CompileContext* context) {
+    freeArena(&context->arena);
+    freeChunk(&context->scratch);
+    freeTokenBuffer(&context->tokens);
+}
+
+static CompileContext* compileContext(VM* vm) {
+    if (vm->compileContext == NULL) {
+        vm->compileContext = ALLOCATE(CompileContext, 1);
+        initCompileContext(vm->compileContext);
+    }
+    return vm->compileContext;
+}
+
+static void initParser(Parser* parser, VM* vm) {
+    CompileContext* context = compileContext(vm);
+    parser->hadError = false;
+    parser->panicMode = false;
+    parser->scanner = NULL;
+    parser->tokens = NULL;
+    parser->nextToken = 0;
+    parser->lineRun = 0;
+    parser->compiler = NULL;
+    parser->chunk = &context->scratch;
+    parser->arena = &context->arena;
+    parser->vm = vm;
+}
+
+// copies scratch into chunk, each array allocated at its final size
+static void finishChunk(const Chunk* scratch, Chunk* chunk) {
+    int count = scratch->count;
+    chunk->code = ALLOCATE(uint8_t, count);
+    chunk->lines = ALLOCATE(int, count);
+    memcpy(chunk->code, scratch->code, count);
+    memcpy(chunk->lines, scratch->lines, sizeof(int) * count);
+    chunk->count = count;
+    chunk->capacity = count;
+    chunk->registerCode = scratch->registerCode;
+
+    const ValueArray* constants = &scratch->constants;
+    chunk->constants.values = ALLOCATE(Value, constants->count);
+    if (constants->count > 0) {
+        memcpy(chunk->constants.values, constants->values,
+               sizeof(Value) * constants->count);
+    }
+    chunk->constants.count = constants->count;
+    chunk->constants.capacity = constants->count;
+}
+
+static bool compileFromParser(Parser* parser, Chunk* chunk) {
+    Compiler* compiler = ARENA_ALLOCATE(parser->arena, Compiler, 1);
+    initCompiler(parser, compiler);
+    advance(parser);
+    while (!match(parser, TOKEN_EOF)) {
+        declaration(parser);
+    }
+    endCompiler(parser);
+    if (!parser->hadError) finishChunk(parser->chunk, chunk);
+
+    // keeps the storage for the next compile
+    parser->chunk->count = 0;
+    parser->chunk->constants.count = 0;
+    parser->chunk->registerCode = false;
+    resetArena(parser->arena);
+    return !parser->hadError;
+}
+
+bool compileTokens(VM* vm, TokenBuffer* tokens, Chunk* chunk) {
+    Parser parser;
+    initParser(&parser, vm);
+    parser.tokens = tokens;
+    return compileFromParser(&parser, chunk);
+}
+
+bool compile(VM* vm, const char* source, Chunk* chunk) {
+    PROBE1(compile__begin, source);
+#ifdef BATCH_TOKENIZE
+    TokenBuffer* tokens = &compileContext(vm)->tokens;
+    tokenize(tokens, source);
+    bool result = compileTokens(vm, tokens, chunk);
+#else
+    Scanner scanner;
+    initScanner(&scanner, source);
+    Parser parser;
+    initParser(&parser, vm);
+    parser.scanner = &scanner;
+    bool result = compileFromParser(&parser, chunk);
+#endif
+    PROBE1(compile__end, result);
+    return result;
 }
@@ -1,8 +1,28 @@
 #ifndef clox_compiler_h
 #define clox_compiler_h
+#include "arena.h"
 #include "chunk.h"
 #include "common.h"
+#include "object.h"
+#include "scanner.h"
 
-bool compile(const char* code, Chunk* chunk);
+// what a vm's compiles reuse, so that compiling many small scripts in a
+// row hardly calls the system allocator: the arena the compiler and its
+// passes take scratch memory from, the chunk code is built up in and
+// the token buffer. each chunk compiled is copied out of scratch at its
+// final size.
+typedef struct CompileContext {
+    Arena arena;
+    Chunk scratch;
+    TokenBuffer tokens;
+} CompileContext;
+
+void initCompileContext(CompileContext* context);
+void freeCompileContext(CompileContext* context);
+
+// string constants are interned in vm, which also holds the context
+bool compile(VM* vm, const char* code, Chunk* chunk);
+// parses a source that was already run through tokenize()
+bool compileTokens(VM* vm, TokenBuffer* tokens, Chunk* chunk);
 
 #endif
\ No newline at end of file
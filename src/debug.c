@@ -1,7 +1,80 @@
 #include "debug.h"
 
+#include "natives.h"
 #include "stdio.h"
 
+static const char* opcodeNames[] = {
+    [OP_RETURN] = "OP_RETURN",
+    [OP_CONSTANT] = "OP_CONSTANT",
+    [OP_DEFINE_GLOBAL] = "OP_DEFINE_GLOBAL",
+    [OP_GET_GLOBAL] = "OP_GET_GLOBAL",
+    [OP_SET_GLOBAL] = "OP_SET_GLOBAL",
+    [OP_GET_LOCAL] = "OP_GET_LOCAL",
+    [OP_SET_LOCAL] = "OP_SET_LOCAL",
+    [OP_TRUE] = "OP_TRUE",
+    [OP_FALSE] = "OP_FALSE",
+    [OP_NIL] = "OP_NIL",
+    [OP_EQUAL] = "OP_EQUAL",
+    [OP_LESS] = "OP_LESS",
+    [OP_GREATER] = "OP_GREATER",
+    [OP_NEGATE] = "OP_NEGATE",
+    [OP_ADD] = "OP_ADD",
+    [OP_SUBTRACT] = "OP_SUBTRACT",
+    [OP_MULTIPLY] = "OP_MULTIPLY",
+    [OP_DIVIDE] = "OP_DIVIDE",
+    [OP_NOT] = "OP_NOT",
+    [OP_PRINT] = "OP_PRINT",
+    [OP_POP] = "OP_POP",
+    [OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+    [OP_LOOP] = "OP_LOOP",
+    [OP_NOT_EQUAL] = "OP_NOT_EQUAL",
+    [OP_LESS_EQUAL] = "OP_LESS_EQUAL",
+    [OP_GREATER_EQUAL] = "OP_GREATER_EQUAL",
+    [OP_SET_LOCAL_POP] = "OP_SET_LOCAL_POP",
+    [OP_SET_GLOBAL_POP] = "OP_SET_GLOBAL_POP",
+    [OP_POPN] = "OP_POPN",
+    [OP_JUMP_IF_FALSE_POP] = "OP_JUMP_IF_FALSE_POP",
+    [OP_ADD_CONSTANT] = "OP_ADD_CONSTANT",
+    [OP_LESS_CONSTANT] = "OP_LESS_CONSTANT",
+    [OP_ADD_NUMBER_CONSTANT] = "OP_ADD_NUMBER_CONSTANT",
+    [OP_ADD_NUMBER] = "OP_ADD_NUMBER",
+    [OP_NEGATE_NUMBER] = "OP_NEGATE_NUMBER",
+    [OP_GET_INDEX] = "OP_GET_INDEX",
+    [OP_SET_INDEX] = "OP_SET_INDEX",
+    [OP_NATIVE] = "OP_NATIVE",
+    [REG_MOVE] = "REG_MOVE",
+    [REG_LOAD_CONSTANT] = "REG_LOAD_CONSTANT",
+    [REG_NIL] = "REG_NIL",
+    [REG_TRUE] = "REG_TRUE",
+    [REG_FALSE] = "REG_FALSE",
+    [REG_EQUAL] = "REG_EQUAL",
+    [REG_LESS] = "REG_LESS",
+    [REG_GREATER] = "REG_GREATER",
+    [REG_ADD] = "REG_ADD",
+    [REG_SUBTRACT] = "REG_SUBTRACT",
+    [REG_MULTIPLY] = "REG_MULTIPLY",
+    [REG_DIVIDE] = "REG_DIVIDE",
+    [REG_NEGATE] = "REG_NEGATE",
+    [REG_NOT] = "REG_NOT",
+    [REG_PRINT] = "REG_PRINT",
+    [REG_DEFINE_GLOBAL] = "REG_DEFINE_GLOBAL",
+    [REG_GET_GLOBAL] = "REG_GET_GLOBAL",
+    [REG_SET_GLOBAL] = "REG_SET_GLOBAL",
+    [REG_JUMP_IF_FALSE] = "REG_JUMP_IF_FALSE",
+    [REG_LOOP] = "REG_LOOP",
+    [REG_RETURN] = "REG_RETURN",
+    [REG_ADD_NUMBER] = "REG_ADD_NUMBER",
+    [REG_NEGATE_NUMBER] = "REG_NEGATE_NUMBER",
+};
+
+const char* opcodeName(uint8_t opcode) {
+    if (opcode >= sizeof(opcodeNames) / sizeof(opcodeNames[0]) ||
+        opcodeNames[opcode] == NULL) {
+        return "OP_UNKNOWN";
+    }
+    return opcodeNames[opcode];
+}
+
 static int simpleInstruction(const char* name, int offset) {
     printf("%s\n", name);
     return offset + 1;
@@ -21,6 +94,63 @@ static int byteInstruction(const char* name, Chunk* chunk, int offset) {
     return offset + 2;
 }
 
+static int nativeInstruction(Chunk* chunk, int offset) {
+    uint8_t native = chunk->code[offset + 1];
+    printf("%-16s %4d '%s'\n", "OP_NATIVE", native, natives[native].name);
+    return offset + 2;
+}
+
+static int jumpInstruction(const char* name, int sign, Chunk* chunk,
+                           int offset) {
+    uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
+    jump |= chunk->code[offset + 2];
+    printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
+    return offset + 3;
+}
+
+static int registerInstruction(Chunk* chunk, int offset) {
+    uint8_t* code = &chunk->code[offset];
+    const char* name = opcodeName(code[0]);
+    int next = offset + REGISTER_INSTRUCTION_SIZE;
+    int jump = (code[2] << 8) | code[3];
+    switch (code[0]) {
+        case REG_LOAD_CONSTANT:
+        case REG_DEFINE_GLOBAL:
+        case REG_GET_GLOBAL:
+        case REG_SET_GLOBAL:
+            printf("%-18s r%-3d %4d '", name, code[1], code[2]);
+            printValue(chunk->constants.values[code[2]]);
+            printf("'\n");
+            break;
+        case REG_JUMP_IF_FALSE:
+            printf("%-18s r%-3d -> %d\n", name, code[1], next + jump);
+            break;
+        case REG_LOOP:
+            printf("%-18s      -> %d\n", name, next - jump);
+            break;
+        case REG_NIL:
+        case REG_TRUE:
+        case REG_FALSE:
+        case REG_PRINT:
+            printf("%-18s r%d\n", name, code[1]);
+            break;
+        case REG_MOVE:
+        case REG_NEGATE:
+        case REG_NEGATE_NUMBER:
+        case REG_NOT:
+            printf("%-18s r%-3d r%d\n", name, code[1], code[2]);
+            break;
+        case REG_RETURN:
+            printf("%s\n", name);
+            break;
+        default:
+            printf("%-18s r%-3d r%-3d r%d\n", name, code[1], code[2],
+                   code[3]);
+            break;
+    }
+    return next;
+}
+
 int disassembleInstruction(Chunk* chunk, int offset) {
     printf("%04d ", offset);
     if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1]) {
@@ -28,6 +158,7 @@ int disassembleInstruction(Chunk* chunk, int offset) {
     } else {
         printf("%4d ", chunk->lines[offset]);
     }
+    if (chunk->registerCode) return registerInstruction(chunk, offset);
 
     uint8_t instruction = chunk->code[offset];
     switch (instruction) {
@@ -51,6 +182,8 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return simpleInstruction("OP_FALSE", offset);
         case OP_NIL:
             return simpleInstruction("OP_NIL", offset);
+        case OP_EQUAL:
+            return simpleInstruction("OP_EQUAL", offset);
         case OP_LESS:
             return simpleInstruction("OP_LESS", offset);
         case OP_GREATER:
@@ -71,6 +204,31 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return simpleInstruction("OP_PRINT", offset);
         case OP_POP:
             return simpleInstruction("OP_POP", offset);
+        case OP_JUMP_IF_FALSE:
+            return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_LOOP:
+            return jumpInstruction("OP_LOOP", -1, chunk, offset);
+        case OP_NOT_EQUAL:
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+        case OP_ADD_NUMBER:
+        case OP_NEGATE_NUMBER:
+        case OP_GET_INDEX:
+        case OP_SET_INDEX:
+            return simpleInstruction(opcodeName(instruction), offset);
+        case OP_NATIVE:
+            return nativeInstruction(chunk, offset);
+        case OP_SET_LOCAL_POP:
+        case OP_POPN:
+            return byteInstruction(opcodeName(instruction), chunk, offset);
+        case OP_SET_GLOBAL_POP:
+        case OP_ADD_CONSTANT:
+        case OP_LESS_CONSTANT:
+        case OP_ADD_NUMBER_CONSTANT:
+            return constantInstruction(opcodeName(instruction), chunk,
+                                       offset);
+        case OP_JUMP_IF_FALSE_POP:
+            return jumpInstruction("OP_JUMP_IF_FALSE_POP", 1, chunk, offset);
         default:
             return offset + 1;
     }
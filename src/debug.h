@@ -5,4 +5,5 @@
 
 void disassembleChunk(Chunk* chunk, const char* name);
 int disassembleInstruction(Chunk* chunk, int offset);
+const char* opcodeName(uint8_t opcode);
 #endif
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include "emit.h"
+
+#include <math.h>
+#include <stdarg.h>
+
+#include "debug.h"
+#include "memory.h"
+#include "object.h"
+
+typedef struct {
+    const Chunk* chunk;
+    FILE* out;
+    bool* targets;
+    // whether anything jumps to the error exit
+    bool fails;
+} Emitter;
+
+// writes one indented line of the program
+static void line(Emitter* emitter, int indent, const char* format, ...) {
+    fprintf(emitter->out, "%*s", indent * 4, "");
+    va_list args;
+    va_start(args, format);
+    vfprintf(emitter->out, format, args);
+    va_end(args);
+    fputc('\n', emitter->out);
+}
+
+static void writeString(FILE* out, const char* chars, int length) {
+    fputc('"', out);
+    for (int i = 0; i < length; i++) {
+        unsigned char c = chars[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < ' ' || c > '~' || c == '?') {
+            // octal, and ? so that nothing reads as a trigraph
+            fprintf(out, "\\%03o", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// the c for a double, exact in hex
+static void writeNumber(FILE* out, double number) {
+    if (isnan(number)) {
+        fprintf(out, "NAN");
+    } else if (isinf(number)) {
+        fprintf(out, number < 0 ? "-HUGE_VAL" : "HUGE_VAL");
+    } else {
+        fprintf(out, "%a", number);
+    }
+}
+
+static void writeConstants(Emitter* emitter) {
+    const ValueArray* constants = &emitter->chunk->constants;
+    for (int i = 0; i < constants->count; i++) {
+        Value value = constants->values[i];
+        fprintf(emitter->out, "    constants[%d] = ", i);
+        if (IS_STRING(value)) {
+            ObjString* string = AS_STRING(value);
+            fprintf(emitter->out, "OBJ_VAL(copyString(&vm, ");
+            writeString(emitter->out, string->chars, string->length);
+            fprintf(emitter->out, ", %d))", string->length);
+        } else if (IS_NUMBER(value)) {
+            fprintf(emitter->out, "NUMBER_VAL(");
+            writeNumber(emitter->out, AS_NUMBER(value));
+            fprintf(emitter->out, ")");
+        } else if (IS_BOOL(value)) {
+            fprintf(emitter->out, "BOOL_VAL(%s)",
+                    AS_BOOL(value) ? "true" : "false");
+        } else {
+            fprintf(emitter->out, "NIL_VAL");
+        }
+        fprintf(emitter->out, ";\n");
+    }
+}
+
+static int jumpTarget(const Chunk* chunk, int offset) {
+    int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    return chunk->code[offset] == OP_LOOP ? offset + 3 - jump
+                                          : offset + 3 + jump;
+}
+
+// marks the jump targets, false if the chunk holds anything unknown
+static bool findTargets(const Chunk* chunk, bool* targets) {
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t instruction = chunk->code[offset];
+        int length = operandLength(instruction);
+        if (length < 0) return false;
+        if (length == 2) {
+            int target = jumpTarget(chunk, offset);
+            if (target < 0 || target > chunk->count) return false;
+            targets[target] = true;
+        }
+        offset += 1 + length;
+    }
+    return true;
+}
+
+static void binary(Emitter* emitter, const char* valueType,
+                   const char* op) {
+    line(emitter, 1, "sp[-2] = %s(AS_NUMBER(sp[-2]) %s AS_NUMBER(sp[-1]));",
+         valueType, op);
+    line(emitter, 1, "sp--;");
+}
+
+static void add(Emitter* emitter, int at) {
+    line(emitter, 1, "if (IS_STRING(sp[-1]) && IS_STRING(sp[-2])) {");
+    line(emitter, 2, "sp[-2] = runtimeConcatenate(&vm, sp[-2], sp[-1]);");
+    line(emitter, 2, "sp--;");
+    line(emitter, 1, "} else if (IS_NUMBER(sp[-1]) && IS_NUMBER(sp[-2])) {");
+    binary(emitter, "NUMBER_VAL", "+");
+    line(emitter, 1, "} else {");
+    line(emitter, 2,
+         "reportError(&vm, %d, \"Operands must be two numbers or two "
+         "strings.\");",
+         at);
+    line(emitter, 2, "goto fail;");
+    line(emitter, 1, "}");
+    emitter->fails = true;
+}
+
+static void pushConstant(Emitter* emitter, int constant) {
+    Value value = emitter->chunk->constants.values[constant];
+    if (!IS_NUMBER(value) || !isfinite(AS_NUMBER(value))) {
+        line(emitter, 1, "*sp++ = constants[%d];", constant);
+        return;
+    }
+    fprintf(emitter->out, "    *sp++ = NUMBER_VAL(");
+    writeNumber(emitter->out, AS_NUMBER(value));
+    fprintf(emitter->out, ");\n");
+}
+
+static void global(Emitter* emitter, uint8_t instruction, int constant,
+                   int at) {
+    line(emitter, 1, "entry = runtimeGlobal(&vm, AS_STRING(constants[%d]), "
+                     "&globals[%d]);",
+         constant, constant);
+    line(emitter, 1, "if (entry == NULL) {");
+    line(emitter, 2,
+         "reportError(&vm, %d, \"Undefined variable '%%s'\", "
+         "AS_STRING(constants[%d])->chars);",
+         at, constant);
+    line(emitter, 2, "goto fail;");
+    line(emitter, 1, "}");
+    if (instruction == OP_GET_GLOBAL) {
+        line(emitter, 1, "*sp++ = entry->value;");
+    } else {
+        line(emitter, 1, "entry->value = sp[-1];");
+        if (instruction == OP_SET_GLOBAL_POP) line(emitter, 1, "sp--;");
+    }
+    emitter->fails = true;
+}
+
+// fails with the error the runtime call before returned, if any
+static void checkError(Emitter* emitter, int at) {
+    line(emitter, 1, "if (error != NULL) {");
+    line(emitter, 2, "reportError(&vm, %d, \"%%s\", error);", at);
+    line(emitter, 2, "goto fail;");
+    line(emitter, 1, "}");
+    emitter->fails = true;
+}
+
+static void emitInstruction(Emitter* emitter, int offset) {
+    const Chunk* chunk = emitter->chunk;
+    uint8_t instruction = chunk->code[offset];
+    int length = operandLength(instruction);
+    int operand = length > 0 ? chunk->code[offset + 1] : 0;
+    int at = chunk->lines[offset];
+
+    if (emitter->targets[offset]) fprintf(emitter->out, "L%d:\n", offset);
+    line(emitter, 1, "// %04d %s", offset, opcodeName(instruction));
+    switch (instruction) {
+        case OP_CONSTANT:
+            pushConstant(emitter, operand);
+            break;
+        case OP_NIL:
+            line(emitter, 1, "*sp++ = NIL_VAL;");
+            break;
+        case OP_TRUE:
+        case OP_FALSE:
+            line(emitter, 1, "*sp++ = BOOL_VAL(%s);",
+                 instruction == OP_TRUE ? "true" : "false");
+            break;
+        case OP_POP:
+            line(emitter, 1, "sp--;");
+            break;
+        case OP_POPN:
+            line(emitter, 1, "sp -= %d;", operand);
+            break;
+        case OP_GET_LOCAL:
+            line(emitter, 1, "*sp++ = stack[%d];", operand);
+            break;
+        case OP_SET_LOCAL:
+            line(emitter, 1, "stack[%d] = sp[-1];", operand);
+            break;
+        case OP_SET_LOCAL_POP:
+            line(emitter, 1, "stack[%d] = *--sp;", operand);
+            break;
+        case OP_DEFINE_GLOBAL:
+            line(emitter, 1,
+                 "mapSet(&vm.globals, AS_STRING(constants[%d]), sp[-1]);",
+                 operand);
+            line(emitter, 1, "sp--;");
+            break;
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_GLOBAL_POP:
+            global(emitter, instruction, operand, at);
+            break;
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+            line(emitter, 1,
+                 "sp[-2] = BOOL_VAL(%svaluesEqual(sp[-2], sp[-1]));",
+                 instruction == OP_NOT_EQUAL ? "!" : "");
+            line(emitter, 1, "sp--;");
+            break;
+        case OP_LESS_CONSTANT:
+            pushConstant(emitter, operand);
+            // fall through
+        case OP_LESS:
+            binary(emitter, "BOOL_VAL", "<");
+            break;
+        case OP_GREATER:
+            binary(emitter, "BOOL_VAL", ">");
+            break;
+        // negated rather than <= and >= so that nan compares the same
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+            line(emitter, 1, "sp[-2] = BOOL_VAL(!(AS_NUMBER(sp[-2]) %s "
+                             "AS_NUMBER(sp[-1])));",
+                 instruction == OP_LESS_EQUAL ? ">" : "<");
+            line(emitter, 1, "sp--;");
+            break;
+        case OP_ADD_CONSTANT:
+            pushConstant(emitter, operand);
+            // fall through
+        case OP_ADD:
+            add(emitter, at);
+            break;
+        case OP_ADD_NUMBER_CONSTANT:
+            pushConstant(emitter, operand);
+            // fall through
+        case OP_ADD_NUMBER:
+            binary(emitter, "NUMBER_VAL", "+");
+            break;
+        case OP_SUBTRACT:
+            binary(emitter, "NUMBER_VAL", "-");
+            break;
+        case OP_MULTIPLY:
+            binary(emitter, "NUMBER_VAL", "*");
+            break;
+        case OP_DIVIDE:
+            binary(emitter, "NUMBER_VAL", "/");
+            break;
+        case OP_NEGATE:
+            // the interpreter fails without a message
+            line(emitter, 1, "if (!IS_NUMBER(sp[-1])) goto fail;");
+            emitter->fails = true;
+            // fall through
+        case OP_NEGATE_NUMBER:
+            line(emitter, 1, "sp[-1] = NUMBER_VAL(-AS_NUMBER(sp[-1]));");
+            break;
+        case OP_NOT:
+            line(emitter, 1, "sp[-1] = BOOL_VAL(runtimeFalsey(sp[-1]));");
+            break;
+        case OP_PRINT:
+            line(emitter, 1, "writeValue(&vm.output, *--sp);");
+            line(emitter, 1, "writeOutput(&vm.output, \"\\n\", 1);");
+            break;
+        case OP_GET_INDEX:
+            line(emitter, 1, "error = arrayGet(sp[-2], sp[-1], &sp[-2]);");
+            checkError(emitter, at);
+            line(emitter, 1, "sp--;");
+            break;
+        case OP_SET_INDEX:
+            line(emitter, 1, "error = arraySet(sp[-3], sp[-2], sp[-1]);");
+            checkError(emitter, at);
+            line(emitter, 1, "sp[-3] = sp[-1];");
+            line(emitter, 1, "sp -= 2;");
+            break;
+        case OP_NATIVE:
+            line(emitter, 1, "error = callNative(&vm, %d, &sp);", operand);
+            checkError(emitter, at);
+            break;
+        case OP_JUMP_IF_FALSE:
+            line(emitter, 1, "if (runtimeFalsey(sp[-1])) goto L%d;",
+                 jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_FALSE_POP:
+            line(emitter, 1, "if (runtimeFalsey(sp[-1])) goto L%d;",
+                 jumpTarget(chunk, offset));
+            line(emitter, 1, "sp--;");
+            break;
+        case OP_LOOP:
+            line(emitter, 1, "goto L%d;", jumpTarget(chunk, offset));
+            break;
+        case OP_RETURN:
+            line(emitter, 1, "goto done;");
+            break;
+    }
+}
+
+bool emitC(const Chunk* chunk, const char* name, FILE* out) {
+    if (chunk->registerCode) return false;
+    Emitter emitter;
+    emitter.chunk = chunk;
+    emitter.out = out;
+    emitter.fails = false;
+    emitter.targets = ALLOCATE(bool, chunk->count + 1);
+    for (int i = 0; i <= chunk->count; i++) emitter.targets[i] = false;
+    if (!findTargets(chunk, emitter.targets)) {
+        FREE_ARRAY(bool, emitter.targets, chunk->count + 1);
+        return false;
+    }
+
+    // every statement leaves the stack as it found it, so it never holds
+    // more values than there are instructions
+    int constantCount = chunk->constants.count;
+    fprintf(out,
+            "// %s, translated by clox --emit-c. build it against the\n"
+            "// //:clox_runtime sources.\n"
+            "#include <math.h>\n"
+            "\n"
+            "#include \"memory.h\"\n"
+            "#include \"runtime.h\"\n"
+            "\n"
+            "#define CAPACITY %d\n"
+            "\n"
+            "int main(void) {\n"
+            "    VM vm;\n"
+            "    initRuntime(&vm);\n"
+            "    static Value constants[%d];\n"
+            "    static Entry* globals[%d];\n",
+            name, chunk->count + 1, constantCount > 0 ? constantCount : 1,
+            constantCount > 0 ? constantCount : 1);
+    writeConstants(&emitter);
+    fprintf(out,
+            "    Value* stack = ALLOCATE(Value, CAPACITY);\n"
+            "    Value* sp = stack;\n"
+            "    Entry* entry;\n"
+            "    const char* error;\n"
+            "    int status = 0;\n"
+            "    (void)constants;\n"
+            "    (void)entry;\n"
+            "    (void)error;\n"
+            "    (void)globals;\n"
+            "\n");
+    for (int offset = 0; offset < chunk->count;) {
+        emitInstruction(&emitter, offset);
+        offset += 1 + operandLength(chunk->code[offset]);
+    }
+    if (emitter.targets[chunk->count]) {
+        fprintf(out, "L%d:\n", chunk->count);
+    }
+    fprintf(out, "    goto done;\n");
+    if (emitter.fails) fprintf(out, "fail:\n    status = 70;\n");
+    fprintf(out,
+            "done:\n"
+            "    FREE_ARRAY(Value, stack, CAPACITY);\n"
+            "    return freeRuntime(&vm, status);\n"
+            "}\n");
+
+    FREE_ARRAY(bool, emitter.targets, chunk->count + 1);
+    return true;
+}
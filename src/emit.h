@@ -0,0 +1,14 @@
+#ifndef clox_emit_h
+#define clox_emit_h
+
+#include <stdio.h>
+
+#include "chunk.h"
+
+// writes chunk to out as a c program that does what running it does,
+// each instruction inline against the library in runtime.h. name ends
+// up in a comment. false if the chunk holds anything it can't
+// translate, register code included.
+bool emitC(const Chunk* chunk, const char* name, FILE* out);
+
+#endif
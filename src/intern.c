@@ -0,0 +1,154 @@
+#include "intern.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "memory.h"
+
+#define SHARED_MIN_CAPACITY 64
+
+// open addressing without deletes, so a slot goes from NULL to a string
+// once and readers can probe while a writer inserts. a full table is
+// replaced rather than resized in place, readers may still be probing the
+// old one, so old tables are kept until freeSharedStrings().
+typedef struct SharedTable {
+    int capacity;
+    struct SharedTable* retired;
+    _Atomic(ObjString*) slots[];
+} SharedTable;
+
+// each shard on its own cache line so writers don't slow down readers of
+// other shards
+typedef struct {
+    alignas(64) _Atomic(SharedTable*) table;
+    atomic_int count;
+    pthread_mutex_t lock;
+} Shard;
+
+static Shard shards[SHARED_SHARD_COUNT];
+static pthread_once_t shardsOnce = PTHREAD_ONCE_INIT;
+
+static void initShards() {
+    for (int i = 0; i < SHARED_SHARD_COUNT; i++) {
+        atomic_init(&shards[i].table, NULL);
+        atomic_init(&shards[i].count, 0);
+        pthread_mutex_init(&shards[i].lock, NULL);
+    }
+}
+
+// the top bits pick the shard, the low bits the slot
+static Shard* shardFor(uint32_t hash) {
+    return &shards[hash >> (32 - SHARED_SHARD_BITS)];
+}
+
+static ObjString* findInTable(SharedTable* table, const char* chars,
+                              int length, uint32_t hash) {
+    if (table == NULL) return NULL;
+    uint32_t mask = table->capacity - 1;
+    uint32_t index = hash & mask;
+    for (;;) {
+        ObjString* string =
+            atomic_load_explicit(&table->slots[index], memory_order_acquire);
+        if (string == NULL) return NULL;
+        if (string->hash == hash && string->length == length &&
+            memcmp(string->chars, chars, length) == 0) {
+            return string;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+ObjString* findSharedString(const char* chars, int length, uint32_t hash) {
+    SharedTable* table = atomic_load_explicit(&shardFor(hash)->table,
+                                              memory_order_acquire);
+    return findInTable(table, chars, length, hash);
+}
+
+static void insertInTable(SharedTable* table, ObjString* string) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t index = string->hash & mask;
+    while (atomic_load_explicit(&table->slots[index],
+                                memory_order_relaxed) != NULL) {
+        index = (index + 1) & mask;
+    }
+    atomic_store_explicit(&table->slots[index], string, memory_order_release);
+}
+
+static SharedTable* growTable(Shard* shard, SharedTable* old) {
+    int capacity = old == NULL ? SHARED_MIN_CAPACITY : old->capacity * 2;
+    SharedTable* table = (SharedTable*)reallocate(
+        NULL, 0, sizeof(SharedTable) + sizeof(ObjString*) * capacity);
+    table->capacity = capacity;
+    table->retired = old;
+    for (int i = 0; i < capacity; i++) {
+        atomic_init(&table->slots[i], NULL);
+    }
+    if (old != NULL) {
+        for (int i = 0; i < old->capacity; i++) {
+            ObjString* string = atomic_load_explicit(&old->slots[i],
+                                                     memory_order_relaxed);
+            if (string != NULL) insertInTable(table, string);
+        }
+    }
+    atomic_store_explicit(&shard->table, table, memory_order_release);
+    return table;
+}
+
+ObjString* addSharedString(ObjString* string) {
+    pthread_once(&shardsOnce, initShards);
+    Shard* shard = shardFor(string->hash);
+    pthread_mutex_lock(&shard->lock);
+    SharedTable* table =
+        atomic_load_explicit(&shard->table, memory_order_relaxed);
+    ObjString* existing =
+        findInTable(table, string->chars, string->length, string->hash);
+    if (existing == NULL) {
+        int count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+        // kept at most half full so probes stay short
+        if (table == NULL || (count + 1) * 2 > table->capacity) {
+            table = growTable(shard, table);
+        }
+        insertInTable(table, string);
+        atomic_store_explicit(&shard->count, count + 1, memory_order_relaxed);
+        existing = string;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return existing;
+}
+
+int sharedStringCount() {
+    int count = 0;
+    for (int i = 0; i < SHARED_SHARD_COUNT; i++) {
+        count += atomic_load_explicit(&shards[i].count, memory_order_relaxed);
+    }
+    return count;
+}
+
+void freeSharedStrings() {
+    for (int i = 0; i < SHARED_SHARD_COUNT; i++) {
+        Shard* shard = &shards[i];
+        SharedTable* table =
+            atomic_load_explicit(&shard->table, memory_order_relaxed);
+        if (table != NULL) {
+            for (int j = 0; j < table->capacity; j++) {
+                ObjString* string = atomic_load_explicit(
+                    &table->slots[j], memory_order_relaxed);
+                if (string == NULL) continue;
+                FREE_ARRAY(char, string->chars, string->length + 1);
+                FREE(ObjString, string);
+            }
+        }
+        while (table != NULL) {
+            SharedTable* retired = table->retired;
+            reallocate(table,
+                       sizeof(SharedTable) +
+                           sizeof(ObjString*) * table->capacity,
+                       0);
+            table = retired;
+        }
+        atomic_store_explicit(&shard->table, NULL, memory_order_relaxed);
+        atomic_store_explicit(&shard->count, 0, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef clox_intern_h
+#define clox_intern_h
+
+#include "object.h"
+
+// the process wide table of immortal strings that every vm shares, the
+// strings of frozen programs live here. it is split into shards by hash:
+// lookups take no lock, inserts lock only their shard.
+#define SHARED_SHARD_BITS 4
+#define SHARED_SHARD_COUNT (1 << SHARED_SHARD_BITS)
+
+ObjString* findSharedString(const char* chars, int length, uint32_t hash);
+// adds string unless an equal one is there already, returns whichever
+// ends up in the table
+ObjString* addSharedString(ObjString* string);
+int sharedStringCount();
+// frees every shared string, once no vm or program uses them
+void freeSharedStrings();
+
+#endif
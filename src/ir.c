@@ -0,0 +1,380 @@
+#include "ir.h"
+
+#include <string.h>
+
+#include "memory.h"
+
+void initIr(Ir* ir, Chunk* chunk, Arena* arena) {
+    ir->chunk = chunk;
+    ir->arena = arena;
+    ir->nodes = NULL;
+    ir->nodeCount = 0;
+    ir->nodeCapacity = 0;
+    ir->statements = NULL;
+    ir->count = 0;
+    ir->capacity = 0;
+}
+
+int addIrNode(Ir* ir, IrNode node) {
+    if (ir->nodeCapacity < ir->nodeCount + 1) {
+        int oldCapacity = ir->nodeCapacity;
+        ir->nodeCapacity = GROW_CAPACITY(oldCapacity);
+        ir->nodes = ARENA_GROW_ARRAY(ir->arena, IrNode, ir->nodes,
+                                     oldCapacity, ir->nodeCapacity);
+    }
+    ir->nodes[ir->nodeCount] = node;
+    return ir->nodeCount++;
+}
+
+static int addStatement(Ir* ir, IrKind kind, int expr, int line) {
+    if (ir->capacity < ir->count + 1) {
+        int oldCapacity = ir->capacity;
+        ir->capacity = GROW_CAPACITY(oldCapacity);
+        ir->statements = ARENA_GROW_ARRAY(ir->arena, IrStatement,
+                                          ir->statements, oldCapacity,
+                                          ir->capacity);
+    }
+    ir->statements[ir->count] = (IrStatement){kind, expr, 0, -1, line};
+    return ir->count++;
+}
+
+int irConstant(Ir* ir, Value value) {
+    ValueArray* constants = &ir->chunk->constants;
+    for (int i = 0; i < constants->count; i++) {
+        Value constant = constants->values[i];
+        // compared bit for bit, 0 and -0 are different constants
+        if (constant.type == value.type &&
+            memcmp(&constant.as, &value.as, sizeof(value.as)) == 0) {
+            return i;
+        }
+    }
+    if (constants->count > UINT8_MAX) return -1;
+    return addConstant(ir->chunk, value);
+}
+
+// the stack while lifting: entries below materialized are on the vm's
+// stack, the ones above are trees no statement has evaluated yet
+typedef struct {
+    Ir* ir;
+    int entries[UINT8_COUNT + 1];
+    int depth;
+    int materialized;
+} Builder;
+
+// evaluates the trees below entry limit as pushes, oldest first
+static void flush(Builder* builder, int limit, int line) {
+    for (int i = builder->materialized; i < limit; i++) {
+        addStatement(builder->ir, IR_PUSH, builder->entries[i], line);
+        builder->entries[i] = -1;
+    }
+    if (limit > builder->materialized) builder->materialized = limit;
+}
+
+// the tree on top, -1 if the value there has been evaluated already
+static int popTree(Builder* builder) {
+    if (builder->depth <= builder->materialized) return -1;
+    return builder->entries[--builder->depth];
+}
+
+static bool pushNode(Builder* builder, uint8_t op, int operand, int left,
+                     int right, int line) {
+    if (builder->depth > UINT8_MAX) return false;
+    IrNode node = {op, operand, left, right, line};
+    builder->entries[builder->depth++] = addIrNode(builder->ir, node);
+    return true;
+}
+
+// the tree on top becomes a statement that consumes it
+static bool endStatement(Builder* builder, IrKind kind, int operand,
+                         int line) {
+    int expr = popTree(builder);
+    if (expr < 0) return false;
+    flush(builder, builder->depth, line);
+    int statement = addStatement(builder->ir, kind, expr, line);
+    builder->ir->statements[statement].operand = operand;
+    return true;
+}
+
+static int jumpTarget(const Chunk* chunk, int offset) {
+    int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    return chunk->code[offset] == OP_LOOP ? offset + 3 - jump
+                                          : offset + 3 + jump;
+}
+
+static bool liftInstruction(Builder* builder, int offset) {
+    const Chunk* chunk = builder->ir->chunk;
+    uint8_t instruction = chunk->code[offset];
+    uint8_t operand =
+        operandLength(instruction) > 0 ? chunk->code[offset + 1] : 0;
+    int line = chunk->lines[offset];
+
+    switch (instruction) {
+        case OP_CONSTANT:
+        case OP_GET_GLOBAL:
+            return pushNode(builder, instruction, operand, -1, -1, line);
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+            return pushNode(builder, instruction, 0, -1, -1, line);
+        case OP_GET_LOCAL:
+            if (operand >= builder->depth) return false;
+            flush(builder, operand + 1, line);
+            return pushNode(builder, instruction, operand, -1, -1, line);
+        case OP_SET_LOCAL: {
+            if (operand >= builder->depth - 1) return false;
+            flush(builder, operand + 1, line);
+            int value = popTree(builder);
+            if (value < 0) return false;
+            return pushNode(builder, instruction, operand, value, -1, line);
+        }
+        case OP_SET_GLOBAL:
+        case OP_NEGATE:
+        case OP_NOT: {
+            int value = popTree(builder);
+            if (value < 0) return false;
+            return pushNode(builder, instruction, operand, value, -1, line);
+        }
+        case OP_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE: {
+            int right = popTree(builder);
+            int left = popTree(builder);
+            if (left < 0 || right < 0) return false;
+            return pushNode(builder, instruction, 0, left, right, line);
+        }
+        case OP_POP:
+            if (builder->depth > builder->materialized) {
+                return endStatement(builder, IR_POP, 0, line);
+            }
+            if (builder->depth == 0) return false;
+            addStatement(builder->ir, IR_DROP, -1, line);
+            builder->ir->statements[builder->ir->count - 1].operand = 1;
+            builder->depth--;
+            builder->materialized--;
+            return true;
+        case OP_PRINT:
+            return endStatement(builder, IR_PRINT, 0, line);
+        case OP_DEFINE_GLOBAL:
+            return endStatement(builder, IR_DEFINE_GLOBAL, operand, line);
+        case OP_JUMP_IF_FALSE:
+            if (!endStatement(builder, IR_BRANCH, 0, line)) return false;
+            // the condition stays on the stack
+            builder->depth++;
+            builder->materialized = builder->depth;
+            break;
+        case OP_LOOP:
+        case OP_RETURN:
+            flush(builder, builder->depth, line);
+            addStatement(builder->ir,
+                         instruction == OP_LOOP ? IR_LOOP : IR_RETURN, -1,
+                         line);
+            break;
+        default:
+            return false;
+    }
+    // jumps hold the bytecode offset they go to until the end
+    if (instruction == OP_JUMP_IF_FALSE || instruction == OP_LOOP) {
+        builder->ir->statements[builder->ir->count - 1].target =
+            jumpTarget(chunk, offset);
+    }
+    return true;
+}
+
+// the stack depth forward jumps arrive at each offset with, -1 if none
+static bool findTargetDepths(const Chunk* chunk, int* depths) {
+    int depth = 0;
+    for (int offset = 0; offset < chunk->count;) {
+        if (depths[offset] >= 0) depth = depths[offset];
+        uint8_t instruction = chunk->code[offset];
+        int length = operandLength(instruction);
+        if (length < 0 || instruction > OP_LOOP) return false;
+        if (instruction == OP_JUMP_IF_FALSE || instruction == OP_LOOP) {
+            int target = jumpTarget(chunk, offset);
+            if (target < 0 || target >= chunk->count) return false;
+            if (instruction == OP_JUMP_IF_FALSE) depths[target] = depth;
+        }
+        switch (instruction) {
+            case OP_CONSTANT:
+            case OP_NIL:
+            case OP_TRUE:
+            case OP_FALSE:
+            case OP_GET_LOCAL:
+            case OP_GET_GLOBAL:
+                depth++;
+                break;
+            case OP_EQUAL:
+            case OP_LESS:
+            case OP_GREATER:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_PRINT:
+            case OP_POP:
+            case OP_DEFINE_GLOBAL:
+                depth--;
+                break;
+        }
+        if (depth < 0 || depth > UINT8_MAX) return false;
+        offset += 1 + length;
+    }
+    return true;
+}
+
+bool buildIr(Ir* ir) {
+    Chunk* chunk = ir->chunk;
+    if (chunk->registerCode) return false;
+    int count = chunk->count;
+    int* depths = ARENA_ALLOCATE(ir->arena, int, count + 1);
+    // the first statement of each jump target
+    int* statementAt = ARENA_ALLOCATE(ir->arena, int, count + 1);
+    bool* targets = ARENA_ALLOCATE(ir->arena, bool, count + 1);
+    for (int i = 0; i <= count; i++) {
+        depths[i] = -1;
+        statementAt[i] = -1;
+        targets[i] = false;
+    }
+
+    bool built = findTargetDepths(chunk, depths);
+    for (int offset = 0; built && offset < count;) {
+        uint8_t instruction = chunk->code[offset];
+        if (instruction == OP_JUMP_IF_FALSE || instruction == OP_LOOP) {
+            targets[jumpTarget(chunk, offset)] = true;
+        }
+        offset += 1 + operandLength(instruction);
+    }
+
+    Builder builder;
+    builder.ir = ir;
+    builder.depth = 0;
+    builder.materialized = 0;
+    for (int offset = 0; built && offset < count;) {
+        if (targets[offset]) {
+            // every path into a target has its values on the stack
+            flush(&builder, builder.depth, chunk->lines[offset]);
+            if (depths[offset] >= 0) {
+                builder.depth = depths[offset];
+                builder.materialized = depths[offset];
+            }
+            statementAt[offset] = ir->count;
+        }
+        built = liftInstruction(&builder, offset);
+        offset += 1 + operandLength(chunk->code[offset]);
+    }
+
+    for (int i = 0; built && i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        if (statement->kind != IR_BRANCH && statement->kind != IR_LOOP) {
+            continue;
+        }
+        statement->target = statementAt[statement->target];
+        if (statement->target < 0) built = false;
+    }
+    return built;
+}
+
+typedef struct {
+    Ir* ir;
+    uint8_t* code;
+    int* lines;
+    int count;
+    int capacity;
+} Lowering;
+
+static void writeByte(Lowering* lowering, uint8_t byte, int line) {
+    if (lowering->capacity < lowering->count + 1) {
+        int oldCapacity = lowering->capacity;
+        lowering->capacity = GROW_CAPACITY(oldCapacity);
+        Arena* arena = lowering->ir->arena;
+        lowering->code = ARENA_GROW_ARRAY(arena, uint8_t, lowering->code,
+                                          oldCapacity, lowering->capacity);
+        lowering->lines = ARENA_GROW_ARRAY(arena, int, lowering->lines,
+                                           oldCapacity, lowering->capacity);
+    }
+    lowering->code[lowering->count] = byte;
+    lowering->lines[lowering->count] = line;
+    lowering->count++;
+}
+
+static void lowerNode(Lowering* lowering, int index) {
+    IrNode* node = &lowering->ir->nodes[index];
+    if (node->left >= 0) lowerNode(lowering, node->left);
+    if (node->right >= 0) lowerNode(lowering, node->right);
+    writeByte(lowering, node->op, node->line);
+    if (operandLength(node->op) == 1) {
+        writeByte(lowering, node->operand, node->line);
+    }
+}
+
+static void lowerStatement(Lowering* lowering, IrStatement* statement) {
+    if (statement->expr >= 0) lowerNode(lowering, statement->expr);
+    int line = statement->line;
+    switch (statement->kind) {
+        case IR_PUSH:
+        case IR_NOP:
+            break;
+        case IR_POP:
+            writeByte(lowering, OP_POP, line);
+            break;
+        case IR_DROP:
+            for (int i = 0; i < statement->operand; i++) {
+                writeByte(lowering, OP_POP, line);
+            }
+            break;
+        case IR_PRINT:
+            writeByte(lowering, OP_PRINT, line);
+            break;
+        case IR_DEFINE_GLOBAL:
+            writeByte(lowering, OP_DEFINE_GLOBAL, line);
+            writeByte(lowering, statement->operand, line);
+            break;
+        case IR_BRANCH:
+        case IR_LOOP:
+            // the distance is filled in once every offset is known
+            writeByte(lowering,
+                      statement->kind == IR_BRANCH ? OP_JUMP_IF_FALSE
+                                                   : OP_LOOP,
+                      line);
+            writeByte(lowering, 0xff, line);
+            writeByte(lowering, 0xff, line);
+            break;
+        case IR_RETURN:
+            writeByte(lowering, OP_RETURN, line);
+            break;
+    }
+}
+
+bool lowerIr(Ir* ir) {
+    Lowering lowering = {ir, NULL, NULL, 0, 0};
+    int* offsets = ARENA_ALLOCATE(ir->arena, int, ir->count + 1);
+    for (int i = 0; i < ir->count; i++) {
+        offsets[i] = lowering.count;
+        lowerStatement(&lowering, &ir->statements[i]);
+    }
+    offsets[ir->count] = lowering.count;
+
+    bool lowered = true;
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        if (statement->kind != IR_BRANCH && statement->kind != IR_LOOP) {
+            continue;
+        }
+        int at = offsets[i + 1] - 3;
+        int after = offsets[i + 1];
+        int target = offsets[statement->target];
+        int distance =
+            statement->kind == IR_LOOP ? after - target : target - after;
+        if (distance < 0 || distance > UINT16_MAX) lowered = false;
+        lowering.code[at + 1] = (distance >> 8) & 0xff;
+        lowering.code[at + 2] = distance & 0xff;
+    }
+
+    if (lowered) {
+        replaceCode(ir->chunk, lowering.code, lowering.lines, lowering.count);
+    }
+    return lowered;
+}
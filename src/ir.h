@@ -0,0 +1,79 @@
+#ifndef clox_ir_h
+#define clox_ir_h
+
+#include "arena.h"
+#include "chunk.h"
+
+// the middle end's form of a chunk: a linear list of statements, each
+// evaluating one expression tree. the trees are the stack code's own
+// post-order, so lowering an ir nothing changed gives back the bytes it
+// was built from. see optimize.h for the passes over it.
+
+// an expression. op is the stack opcode that computes it.
+typedef struct {
+    uint8_t op;
+    // the slot of OP_GET_LOCAL and OP_SET_LOCAL, the constant of
+    // OP_CONSTANT and of the global ops
+    int operand;
+    // the operands, -1 where there is none. stores keep the value in
+    // left.
+    int left;
+    int right;
+    int line;
+} IrNode;
+
+typedef enum {
+    // leaves the value of expr on the stack, a local or a condition
+    IR_PUSH,
+    // evaluates expr for its effects
+    IR_POP,
+    // pops operand values left by earlier statements
+    IR_DROP,
+    IR_PRINT,
+    // defines the global named by constant operand as expr
+    IR_DEFINE_GLOBAL,
+    // pushes expr and jumps to statement target if it is falsey
+    IR_BRANCH,
+    // jumps back to statement target
+    IR_LOOP,
+    IR_RETURN,
+    // removed, lowers to nothing
+    IR_NOP,
+} IrKind;
+
+typedef struct {
+    IrKind kind;
+    // the root node, -1 if the statement evaluates nothing
+    int expr;
+    int operand;
+    int target;
+    int line;
+} IrStatement;
+
+typedef struct {
+    Chunk* chunk;
+    // holds the ir and the scratch memory of the passes over it
+    Arena* arena;
+    IrNode* nodes;
+    int nodeCount;
+    int nodeCapacity;
+    IrStatement* statements;
+    int count;
+    int capacity;
+} Ir;
+
+// an ir of chunk, taking its memory from arena. resetting the arena
+// frees it.
+void initIr(Ir* ir, Chunk* chunk, Arena* arena);
+int addIrNode(Ir* ir, IrNode node);
+// the constant table index of value, added if it isn't there yet. -1 if
+// the table is full.
+int irConstant(Ir* ir, Value value);
+// lifts the stack code of ir's chunk. false if the chunk holds anything
+// the ir can't express, superinstructions and register code included.
+bool buildIr(Ir* ir);
+// replaces the chunk's code with the ir's. false, leaving the chunk as
+// it was, if a jump no longer fits its operand.
+bool lowerIr(Ir* ir);
+
+#endif
@@ -0,0 +1,685 @@
+#include "jit.h"
+
+#ifdef ENABLE_JIT
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "memory.h"
+#include "sampler.h"
+#include "vm.h"
+
+// registers, numbered as the instruction encoding does. xmm registers
+// use the same numbers.
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+// pinned while compiled code runs: the stack top, the vm and the bottom
+// of the stack, which locals are relative to
+#define TOP RBX
+#define VMR R12
+#define BASE R13
+
+#define VALUE_SIZE ((int)sizeof(Value))
+#define TYPE_AT(slot) ((slot) * VALUE_SIZE + (int)offsetof(Value, type))
+#define PAYLOAD_AT(slot) ((slot) * VALUE_SIZE + (int)offsetof(Value, as))
+
+#define COND_B 0x2
+#define COND_AE 0x3
+#define COND_E 0x4
+#define COND_NE 0x5
+#define COND_A 0x7
+
+typedef JitExit (*JitFunction)(VM* vm, const uint8_t* entry);
+
+struct JitCode {
+    const Chunk* chunk;
+    uint8_t* code;
+    size_t size;
+    // where each bytecode offset starts in code, -1 if it can't be
+    // entered there. entryCount is the chunk's count, kept so that the
+    // code can be freed after the chunk.
+    int* entries;
+    int entryCount;
+};
+
+// a jump to a bytecode offset, patched once all of them are placed
+typedef struct {
+    int at;
+    int target;
+} Patch;
+
+typedef struct {
+    const Chunk* chunk;
+    uint8_t* code;
+    int count;
+    int capacity;
+    int* offsets;
+    Patch* patches;
+    int patchCount;
+    int patchCapacity;
+    int epilogue;
+    // counters the code has run past but not yet added to the vm, they
+    // are added in one go before anything can observe them
+    uint32_t pendingInstructions;
+    uint32_t pendingOps[UINT8_COUNT];
+} Assembler;
+
+static void emitByte(Assembler* as, uint8_t byte) {
+    if (as->capacity < as->count + 1) {
+        int oldCapacity = as->capacity;
+        as->capacity = GROW_CAPACITY(oldCapacity);
+        as->code = GROW_ARRAY(uint8_t, as->code, oldCapacity, as->capacity);
+    }
+    as->code[as->count++] = byte;
+}
+
+static void emit32(Assembler* as, uint32_t value) {
+    for (int i = 0; i < 4; i++) emitByte(as, (value >> (8 * i)) & 0xff);
+}
+
+static void emit64(Assembler* as, uint64_t value) {
+    for (int i = 0; i < 8; i++) emitByte(as, (value >> (8 * i)) & 0xff);
+}
+
+static void emitOpcode(Assembler* as, uint32_t opcode) {
+    if (opcode > 0xff) emitByte(as, opcode >> 8);
+    emitByte(as, opcode & 0xff);
+}
+
+static void emitRex(Assembler* as, bool wide, int reg, int base) {
+    uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (base >> 3);
+    if (rex != 0x40) emitByte(as, rex);
+}
+
+// an instruction on [base + disp], always with a 32-bit displacement
+static void emitMem(Assembler* as, uint8_t prefix, bool wide,
+                    uint32_t opcode, int reg, int base, int32_t disp) {
+    if (prefix != 0) emitByte(as, prefix);
+    emitRex(as, wide, reg, base);
+    emitOpcode(as, opcode);
+    emitByte(as, 0x80 | ((reg & 7) << 3) | (base & 7));
+    // rsp and r12 as a base need a sib byte
+    if ((base & 7) == RSP) emitByte(as, 0x24);
+    emit32(as, (uint32_t)disp);
+}
+
+// an instruction on two registers, rm is the destination of a move
+static void emitRegs(Assembler* as, bool wide, uint32_t opcode, int reg,
+                     int rm) {
+    emitRex(as, wide, reg, rm);
+    emitOpcode(as, opcode);
+    emitByte(as, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emitLoadImm64(Assembler* as, int reg, uint64_t value) {
+    emitRex(as, true, 0, reg);
+    emitByte(as, 0xb8 + (reg & 7));
+    emit64(as, value);
+}
+
+static void emitLoadImm32(Assembler* as, int reg, uint32_t value) {
+    emitRex(as, false, 0, reg);
+    emitByte(as, 0xb8 + (reg & 7));
+    emit32(as, value);
+}
+
+static void emitLoad(Assembler* as, int reg, int base, int32_t disp) {
+    emitMem(as, 0, true, 0x8b, reg, base, disp);
+}
+
+static void emitStore(Assembler* as, int base, int32_t disp, int reg) {
+    emitMem(as, 0, true, 0x89, reg, base, disp);
+}
+
+static void emitStoreType(Assembler* as, int base, int32_t disp,
+                          ValueType type) {
+    emitMem(as, 0, false, 0xc7, 0, base, disp);
+    emit32(as, type);
+}
+
+static void emitCompareType(Assembler* as, int base, int32_t disp,
+                            ValueType type) {
+    emitMem(as, 0, false, 0x83, 7, base, disp);
+    emitByte(as, type);
+}
+
+// moves the top of the stack by slots values
+static void emitMoveTop(Assembler* as, int slots) {
+    emitMem(as, 0, true, 0x8d, TOP, TOP, slots * VALUE_SIZE);
+}
+
+// copies a whole value through xmm0
+static void emitCopyValue(Assembler* as, int toBase, int32_t toDisp,
+                          int fromBase, int32_t fromDisp) {
+    emitMem(as, 0, false, 0x0f10, 0, fromBase, fromDisp);
+    emitMem(as, 0, false, 0x0f11, 0, toBase, toDisp);
+}
+
+static void emitPushValue(Assembler* as, int base, int32_t disp) {
+    emitCopyValue(as, TOP, 0, base, disp);
+    emitMoveTop(as, 1);
+}
+
+// a forward jump within a template, returns where to patch it
+static int emitJump(Assembler* as, int condition) {
+    if (condition < 0) {
+        emitByte(as, 0xe9);
+    } else {
+        emitByte(as, 0x0f);
+        emitByte(as, 0x80 | condition);
+    }
+    emit32(as, 0);
+    return as->count - 4;
+}
+
+static void patchJump(Assembler* as, int at, int target) {
+    uint32_t rel = (uint32_t)(target - (at + 4));
+    memcpy(as->code + at, &rel, 4);
+}
+
+static void patchHere(Assembler* as, int at) { patchJump(as, at, as->count); }
+
+static void emitJumpTo(Assembler* as, int condition, int target) {
+    patchJump(as, emitJump(as, condition), target);
+}
+
+// a jump to the code of a bytecode offset
+static void emitBranch(Assembler* as, int condition, int target) {
+    int at = emitJump(as, condition);
+    if (as->patchCapacity < as->patchCount + 1) {
+        int oldCapacity = as->patchCapacity;
+        as->patchCapacity = GROW_CAPACITY(oldCapacity);
+        as->patches = GROW_ARRAY(Patch, as->patches, oldCapacity,
+                                 as->patchCapacity);
+    }
+    as->patches[as->patchCount++] = (Patch){at, target};
+}
+
+static void countInstruction(Assembler* as, uint8_t instruction) {
+    as->pendingInstructions++;
+    as->pendingOps[instruction]++;
+}
+
+static void emitCounts(Assembler* as) {
+    if (as->pendingInstructions == 0) return;
+    emitMem(as, 0, true, 0x81, 0, VMR, offsetof(VM, instructionCount));
+    emit32(as, as->pendingInstructions);
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        if (as->pendingOps[i] == 0) continue;
+        emitMem(as, 0, true, 0x81, 0, VMR,
+                offsetof(VM, opcodeCounts) + i * sizeof(uint64_t));
+        emit32(as, as->pendingOps[i]);
+    }
+}
+
+static void clearCounts(Assembler* as) {
+    as->pendingInstructions = 0;
+    memset(as->pendingOps, 0, sizeof(as->pendingOps));
+}
+
+static void flushCounts(Assembler* as) {
+    emitCounts(as);
+    clearCounts(as);
+}
+
+static void emitSetIp(Assembler* as, int offset) {
+    emitLoadImm64(as, RAX, (uintptr_t)(as->chunk->code + offset));
+    emitStore(as, VMR, offsetof(VM, ip), RAX);
+}
+
+static void emitExit(Assembler* as, int offset, JitExit exit) {
+    emitSetIp(as, offset);
+    emitLoadImm32(as, RAX, exit);
+    emitJumpTo(as, -1, as->epilogue);
+}
+
+// calls the helper at address helper with the vm and an int, ip points
+// at offset meanwhile so that errors report the right line
+static void emitCall(Assembler* as, int offset, uintptr_t helper,
+                     int argument) {
+    emitStore(as, VMR, offsetof(VM, stackTop), TOP);
+    emitSetIp(as, offset);
+    emitRegs(as, true, 0x89, VMR, RDI);
+    emitLoadImm32(as, RSI, argument);
+    emitLoadImm64(as, RAX, helper);
+    emitByte(as, 0xff);
+    emitByte(as, 0xd0);
+    emitLoad(as, TOP, VMR, offsetof(VM, stackTop));
+}
+
+// leaves with JIT_ERROR unless the helper just called returned true
+static void emitCheckHelper(Assembler* as) {
+    emitByte(as, 0x84);
+    emitByte(as, 0xc0);
+    int ok = emitJump(as, COND_NE);
+    emitLoadImm32(as, RAX, JIT_ERROR);
+    emitJumpTo(as, -1, as->epilogue);
+    patchHere(as, ok);
+}
+
+// ecx = isFalsey(top of the stack)
+static void emitIsFalsey(Assembler* as) {
+    emitRegs(as, false, 0x31, RCX, RCX);
+    emitCompareType(as, TOP, TYPE_AT(-1), VAL_NIL);
+    int notNil = emitJump(as, COND_NE);
+    emitLoadImm32(as, RCX, 1);
+    int done = emitJump(as, -1);
+    patchHere(as, notNil);
+    emitCompareType(as, TOP, TYPE_AT(-1), VAL_BOOL);
+    int notBool = emitJump(as, COND_NE);
+    emitMem(as, 0, false, 0x0fb6, RCX, TOP, PAYLOAD_AT(-1));
+    emitByte(as, 0x83);
+    emitByte(as, 0xf1);
+    emitByte(as, 0x01);
+    patchHere(as, done);
+    patchHere(as, notBool);
+}
+
+// a = a op b on the two numbers on top, op is an sse2 opcode
+static void emitArithmetic(Assembler* as, uint32_t opcode) {
+    emitMem(as, 0xf2, false, 0x0f10, 0, TOP, PAYLOAD_AT(-2));
+    emitMem(as, 0xf2, false, opcode, 0, TOP, PAYLOAD_AT(-1));
+    emitMem(as, 0xf2, false, 0x0f11, 0, TOP, PAYLOAD_AT(-2));
+    emitStoreType(as, TOP, TYPE_AT(-2), VAL_NUMBER);
+    emitMoveTop(as, -1);
+}
+
+// a < b or a > b, like run() it doesn't look at the types
+static void emitComparison(Assembler* as, bool less) {
+    int left = less ? PAYLOAD_AT(-1) : PAYLOAD_AT(-2);
+    int right = less ? PAYLOAD_AT(-2) : PAYLOAD_AT(-1);
+    emitMem(as, 0xf2, false, 0x0f10, 0, TOP, left);
+    emitMem(as, 0x66, false, 0x0f2e, 0, TOP, right);
+    // seta al, false when unordered as in c
+    emitByte(as, 0x0f);
+    emitByte(as, 0x90 | COND_A);
+    emitByte(as, 0xc0);
+    emitRegs(as, false, 0x0fb6, RAX, RAX);
+    emitStore(as, TOP, PAYLOAD_AT(-2), RAX);
+    emitStoreType(as, TOP, TYPE_AT(-2), VAL_BOOL);
+    emitMoveTop(as, -1);
+}
+
+// a + b on the two values on top, numbers inline and anything else in
+// jitAdd(). next is where the interpreter would carry on.
+static void emitAdd(Assembler* as, int next) {
+    emitCompareType(as, TOP, TYPE_AT(-1), VAL_NUMBER);
+    int slow = emitJump(as, COND_NE);
+    emitCompareType(as, TOP, TYPE_AT(-2), VAL_NUMBER);
+    int slowToo = emitJump(as, COND_NE);
+    emitArithmetic(as, 0x0f58);
+    emitCounts(as);
+    int done = emitJump(as, -1);
+    patchHere(as, slow);
+    patchHere(as, slowToo);
+    emitCounts(as);
+    emitCall(as, next, (uintptr_t)jitAdd, 0);
+    emitCheckHelper(as);
+    patchHere(as, done);
+    clearCounts(as);
+}
+
+// replaces the top of the stack with whether it is falsey
+static void emitNot(Assembler* as) {
+    emitIsFalsey(as);
+    emitStore(as, TOP, PAYLOAD_AT(-1), RCX);
+    emitStoreType(as, TOP, TYPE_AT(-1), VAL_BOOL);
+}
+
+static void emitPushConstant(Assembler* as, int constant) {
+    emitLoadImm64(as, RAX,
+                  (uintptr_t)&as->chunk->constants.values[constant]);
+    emitPushValue(as, RAX, 0);
+}
+
+// the loop check run() does at OP_LOOP, cheap unless the budget or the
+// sampler needs looking at
+static void emitLoop(Assembler* as, int target) {
+    emitLoad(as, RAX, VMR, offsetof(VM, instructionCount));
+    emitMem(as, 0, true, 0x3b, RAX, VMR, offsetof(VM, nextCheck));
+    int slow = emitJump(as, COND_AE);
+    emitLoadImm64(as, RAX, (uintptr_t)&samplerNeedsDrain);
+    emitCompareType(as, RAX, 0, 0);
+    int drain = emitJump(as, COND_NE);
+    emitBranch(as, -1, target);
+
+    patchHere(as, slow);
+    patchHere(as, drain);
+    emitCall(as, target, (uintptr_t)jitLoopCheck, 0);
+    emitByte(as, 0x84);
+    emitByte(as, 0xc0);
+    emitBranch(as, COND_E, target);
+    emitLoadImm32(as, RAX, JIT_BUDGET);
+    emitJumpTo(as, -1, as->epilogue);
+}
+
+static int jumpOperand(const Chunk* chunk, int offset) {
+    return (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+}
+
+// loads the vm registers and jumps to the entry passed in rsi
+static void emitPrologue(Assembler* as) {
+    emitByte(as, 0x53);
+    emitByte(as, 0x41);
+    emitByte(as, 0x50 | (VMR & 7));
+    emitByte(as, 0x41);
+    // three pushes leave the stack 16 byte aligned for calls
+    emitByte(as, 0x50 | (BASE & 7));
+    emitRegs(as, true, 0x89, RDI, VMR);
+    emitLoad(as, TOP, VMR, offsetof(VM, stackTop));
+    emitLoad(as, BASE, VMR, offsetof(VM, stack));
+    emitByte(as, 0xff);
+    emitByte(as, 0xe6);
+}
+
+// every exit comes through here with the exit code in eax
+static void emitEpilogue(Assembler* as) {
+    as->epilogue = as->count;
+    emitStore(as, VMR, offsetof(VM, stackTop), TOP);
+    emitByte(as, 0x41);
+    emitByte(as, 0x58 | (BASE & 7));
+    emitByte(as, 0x41);
+    emitByte(as, 0x58 | (VMR & 7));
+    emitByte(as, 0x5b);
+    emitByte(as, 0xc3);
+}
+
+static void compileInstruction(Assembler* as, int offset) {
+    const Chunk* chunk = as->chunk;
+    uint8_t instruction = chunk->code[offset];
+    int next = offset + 1 + operandLength(instruction);
+    uint8_t operand = next > offset + 1 ? chunk->code[offset + 1] : 0;
+
+    switch (instruction) {
+        case OP_CONSTANT:
+            countInstruction(as, instruction);
+            emitPushConstant(as, operand);
+            break;
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+            countInstruction(as, instruction);
+            emitStoreType(as, TOP, TYPE_AT(0),
+                          instruction == OP_NIL ? VAL_NIL : VAL_BOOL);
+            emitMem(as, 0, true, 0xc7, 0, TOP, PAYLOAD_AT(0));
+            emit32(as, instruction == OP_TRUE);
+            emitMoveTop(as, 1);
+            break;
+        case OP_POP:
+            countInstruction(as, instruction);
+            emitMoveTop(as, -1);
+            break;
+        case OP_POPN:
+            countInstruction(as, instruction);
+            emitMoveTop(as, -operand);
+            break;
+        case OP_GET_LOCAL:
+            countInstruction(as, instruction);
+            emitPushValue(as, BASE, operand * VALUE_SIZE);
+            break;
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_POP:
+            countInstruction(as, instruction);
+            emitCopyValue(as, BASE, operand * VALUE_SIZE, TOP, -VALUE_SIZE);
+            if (instruction == OP_SET_LOCAL_POP) emitMoveTop(as, -1);
+            break;
+        case OP_ADD:
+            countInstruction(as, instruction);
+            emitAdd(as, next);
+            break;
+        case OP_ADD_CONSTANT:
+            countInstruction(as, instruction);
+            emitPushConstant(as, operand);
+            emitAdd(as, next);
+            break;
+        case OP_ADD_NUMBER:
+            countInstruction(as, instruction);
+            emitArithmetic(as, 0x0f58);
+            break;
+        case OP_ADD_NUMBER_CONSTANT:
+            countInstruction(as, instruction);
+            emitPushConstant(as, operand);
+            emitArithmetic(as, 0x0f58);
+            break;
+        case OP_SUBTRACT:
+            countInstruction(as, instruction);
+            emitArithmetic(as, 0x0f5c);
+            break;
+        case OP_MULTIPLY:
+            countInstruction(as, instruction);
+            emitArithmetic(as, 0x0f59);
+            break;
+        case OP_DIVIDE:
+            countInstruction(as, instruction);
+            emitArithmetic(as, 0x0f5e);
+            break;
+        case OP_LESS:
+        case OP_GREATER:
+            countInstruction(as, instruction);
+            emitComparison(as, instruction == OP_LESS);
+            break;
+        case OP_LESS_CONSTANT:
+            countInstruction(as, instruction);
+            emitPushConstant(as, operand);
+            emitComparison(as, true);
+            break;
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+            countInstruction(as, instruction);
+            emitComparison(as, instruction == OP_GREATER_EQUAL);
+            emitNot(as);
+            break;
+        case OP_NEGATE: {
+            // the interpreter reports anything but a number
+            flushCounts(as);
+            emitCompareType(as, TOP, TYPE_AT(-1), VAL_NUMBER);
+            int number = emitJump(as, COND_E);
+            emitExit(as, offset, JIT_INTERPRET);
+            patchHere(as, number);
+            countInstruction(as, instruction);
+            emitLoadImm64(as, RAX, 0x8000000000000000u);
+            emitMem(as, 0, true, 0x31, RAX, TOP, PAYLOAD_AT(-1));
+            break;
+        }
+        case OP_NEGATE_NUMBER:
+            countInstruction(as, instruction);
+            emitLoadImm64(as, RAX, 0x8000000000000000u);
+            emitMem(as, 0, true, 0x31, RAX, TOP, PAYLOAD_AT(-1));
+            break;
+        case OP_NOT:
+            countInstruction(as, instruction);
+            emitNot(as);
+            break;
+        case OP_NOT_EQUAL:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitCall(as, next, (uintptr_t)jitEqual, 0);
+            emitNot(as);
+            break;
+        case OP_EQUAL:
+        case OP_PRINT:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitCall(as, next,
+                     instruction == OP_EQUAL ? (uintptr_t)jitEqual
+                                             : (uintptr_t)jitPrint,
+                     0);
+            break;
+        case OP_DEFINE_GLOBAL:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitCall(as, next, (uintptr_t)jitDefineGlobal, operand);
+            break;
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_GLOBAL_POP:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitCall(as, next,
+                     instruction == OP_GET_GLOBAL ? (uintptr_t)jitGetGlobal
+                                                  : (uintptr_t)jitSetGlobal,
+                     operand);
+            emitCheckHelper(as);
+            if (instruction == OP_SET_GLOBAL_POP) emitMoveTop(as, -1);
+            break;
+        case OP_GET_INDEX:
+        case OP_SET_INDEX:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitCall(as, next,
+                     instruction == OP_GET_INDEX ? (uintptr_t)jitGetIndex
+                                                 : (uintptr_t)jitSetIndex,
+                     0);
+            emitCheckHelper(as);
+            break;
+        case OP_NATIVE:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitCall(as, next, (uintptr_t)jitNative, operand);
+            emitCheckHelper(as);
+            break;
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_FALSE_POP:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitIsFalsey(as);
+            emitRegs(as, false, 0x85, RCX, RCX);
+            emitBranch(as, COND_NE, next + jumpOperand(chunk, offset));
+            if (instruction == OP_JUMP_IF_FALSE_POP) emitMoveTop(as, -1);
+            break;
+        case OP_LOOP:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitLoop(as, next - jumpOperand(chunk, offset));
+            break;
+        case OP_RETURN:
+            countInstruction(as, instruction);
+            flushCounts(as);
+            emitExit(as, next, JIT_RETURN);
+            break;
+    }
+}
+
+// marks the offsets jumps land on, code is only entered and counters
+// only settled there. returns how far the chunk can be decoded.
+static int findTargets(const Chunk* chunk, bool* targets) {
+    int offset = 0;
+    while (offset < chunk->count) {
+        uint8_t instruction = chunk->code[offset];
+        int length = operandLength(instruction);
+        if (length < 0) break;
+        int next = offset + 1 + length;
+        if (instruction == OP_JUMP_IF_FALSE ||
+            instruction == OP_JUMP_IF_FALSE_POP) {
+            int target = next + jumpOperand(chunk, offset);
+            if (target < chunk->count) targets[target] = true;
+        } else if (instruction == OP_LOOP) {
+            int target = next - jumpOperand(chunk, offset);
+            if (target >= 0) targets[target] = true;
+        }
+        offset = next;
+    }
+    return offset;
+}
+
+static JitCode* finish(Assembler* as, bool* targets) {
+    // jumps to code that wasn't compiled hand over to the interpreter
+    for (int i = 0; i < as->patchCount; i++) {
+        Patch* patch = &as->patches[i];
+        if (as->offsets[patch->target] < 0) {
+            as->offsets[patch->target] = as->count;
+            emitExit(as, patch->target, JIT_INTERPRET);
+            targets[patch->target] = false;
+        }
+        patchJump(as, patch->at, as->offsets[patch->target]);
+    }
+
+    void* memory = mmap(NULL, as->count, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return NULL;
+    memcpy(memory, as->code, as->count);
+    if (mprotect(memory, as->count, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, as->count);
+        return NULL;
+    }
+
+    JitCode* code = ALLOCATE(JitCode, 1);
+    code->chunk = as->chunk;
+    code->code = memory;
+    code->size = as->count;
+    code->entries = ALLOCATE(int, as->chunk->count);
+    code->entryCount = as->chunk->count;
+    for (int i = 0; i < as->chunk->count; i++) {
+        code->entries[i] = targets[i] ? as->offsets[i] : -1;
+    }
+    return code;
+}
+
+static JitCode* compileJit(const Chunk* chunk) {
+    Assembler as;
+    memset(&as, 0, sizeof(as));
+    as.chunk = chunk;
+    as.offsets = ALLOCATE(int, chunk->count + 1);
+    bool* targets = ALLOCATE(bool, chunk->count + 1);
+    for (int i = 0; i <= chunk->count; i++) {
+        as.offsets[i] = -1;
+        targets[i] = false;
+    }
+
+    emitPrologue(&as);
+    emitEpilogue(&as);
+    int end = findTargets(chunk, targets);
+    int offset = 0;
+    while (offset < end) {
+        // counters have to be right whichever way control gets here
+        if (targets[offset]) flushCounts(&as);
+        as.offsets[offset] = as.count;
+        compileInstruction(&as, offset);
+        offset += 1 + operandLength(chunk->code[offset]);
+    }
+    if (end < chunk->count) {
+        flushCounts(&as);
+        as.offsets[end] = as.count;
+        emitExit(&as, end, JIT_INTERPRET);
+    }
+
+    JitCode* code = finish(&as, targets);
+    FREE_ARRAY(uint8_t, as.code, as.capacity);
+    FREE_ARRAY(Patch, as.patches, as.patchCapacity);
+    FREE_ARRAY(int, as.offsets, chunk->count + 1);
+    FREE_ARRAY(bool, targets, chunk->count + 1);
+    return code;
+}
+
+void freeJit(JitCode* code) {
+    if (code == NULL) return;
+    munmap(code->code, code->size);
+    FREE_ARRAY(int, code->entries, code->entryCount);
+    FREE(JitCode, code);
+}
+
+JitExit runJit(VM* vm) {
+    if (vm->jit != NULL && vm->jit->chunk != vm->chunk) {
+        freeJit(vm->jit);
+        vm->jit = NULL;
+    }
+    if (vm->jit == NULL) {
+        vm->jit = compileJit(vm->chunk);
+        if (vm->jit == NULL) {
+            // try again after another JIT_THRESHOLD loops
+            vm->loopCount = 0;
+            return JIT_INTERPRET;
+        }
+    }
+    int entry = vm->jit->entries[vm->ip - vm->chunk->code];
+    if (entry < 0) return JIT_INTERPRET;
+    JitFunction function = (JitFunction)(void*)vm->jit->code;
+    return function(vm, vm->jit->code + entry);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef clox_jit_h
+#define clox_jit_h
+
+#include "chunk.h"
+#include "object.h"
+
+// a baseline jit: once a run has taken JIT_THRESHOLD backward jumps its
+// chunk is translated to x86-64, one template per instruction, and the
+// run carries on in machine code from the loop it was in. values stay on
+// the vm's stack in the same layout, so the interpreter can take over
+// again at any instruction the code doesn't handle.
+#define JIT_THRESHOLD 1000
+
+typedef struct JitCode JitCode;
+
+// why compiled code handed control back
+typedef enum {
+    // OP_RETURN ran
+    JIT_RETURN,
+    // the interpreter carries on at vm->ip
+    JIT_INTERPRET,
+    // a runtime error was reported
+    JIT_ERROR,
+    // the budget ran out at the backward jump to vm->ip
+    JIT_BUDGET,
+} JitExit;
+
+#ifdef ENABLE_JIT
+
+// runs vm's chunk from vm->ip, which has to be a loop start, compiling
+// it first if it isn't yet
+JitExit runJit(VM* vm);
+void freeJit(JitCode* code);
+
+// the runtime helpers compiled code calls, defined in vm.c. each does
+// what the opcode of the same name does in run(), jitAdd() for anything
+// but two numbers.
+bool jitAdd(VM* vm);
+void jitEqual(VM* vm);
+void jitPrint(VM* vm);
+void jitDefineGlobal(VM* vm, int constant);
+bool jitGetGlobal(VM* vm, int constant);
+bool jitSetGlobal(VM* vm, int constant);
+bool jitGetIndex(VM* vm);
+bool jitSetIndex(VM* vm);
+bool jitNative(VM* vm, int index);
+// true when the run has to stop at this backward jump
+bool jitLoopCheck(VM* vm);
+
+#endif
+
+#endif
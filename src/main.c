@@ -1,29 +1,96 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "chunk.h"
 #include "common.h"
+#include "compiler.h"
 #include "debug.h"
+#include "emit.h"
+#include "runner.h"
+#include "sampler.h"
 #include "stdio.h"
 #include "vm.h"
 
-void repl();
-void runFile(const char* file);
+void repl(VM* vm);
+void runFile(VM* vm, const char* file);
+void emitFile(VM* vm, const char* file);
+
+// reports written after the script ran, when set
+static const char* sampleProfilePath = NULL;
+static const char* statsPath = NULL;
+// 0 for no limit
+static Budget budget = {0, 0};
+static int optLevel = 0;
+// where --emit-c writes the script translated to c, when set
+static const char* emitPath = NULL;
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: clox [--sample-profile out.folded] "
+            "[--stats-json out.json] [--max-instructions N]\n"
+            "            [--timeout-ms N] [--opt-level N] [path]\n"
+            "       clox --emit-c out.c [--opt-level N] path\n"
+            "       clox --jobs N [--max-instructions N] [--timeout-ms N] "
+            "[--opt-level N] path...\n");
+    exit(64);
+}
 
 int main(int argc, const char* argv[]) {
-    initVM();
-    if (argc == 1) {
-        repl();
-    } else if (argc == 2) {
-        runFile(argv[2]);
+#ifdef PROFILE_OPCODES
+    // one report for the whole run, however it ends
+    atexit(reportProfile);
+#endif
+    int first = 1;
+    int jobs = -1;
+    while (first + 1 < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--sample-profile") == 0) {
+            sampleProfilePath = argv[first + 1];
+        } else if (strcmp(argv[first], "--stats-json") == 0) {
+            statsPath = argv[first + 1];
+        } else if (strcmp(argv[first], "--jobs") == 0) {
+            jobs = atoi(argv[first + 1]);
+        } else if (strcmp(argv[first], "--max-instructions") == 0) {
+            budget.instructions = strtoull(argv[first + 1], NULL, 10);
+        } else if (strcmp(argv[first], "--timeout-ms") == 0) {
+            budget.nanos = strtoull(argv[first + 1], NULL, 10) * 1000000;
+        } else if (strcmp(argv[first], "--emit-c") == 0) {
+            emitPath = argv[first + 1];
+        } else if (strcmp(argv[first], "--opt-level") == 0) {
+            optLevel = atoi(argv[first + 1]);
+        } else {
+            break;
+        }
+        first += 2;
+    }
+
+    if (jobs >= 0) {
+        // 0 picks one worker per core
+        if (first == argc || sampleProfilePath != NULL || statsPath != NULL ||
+            emitPath != NULL) {
+            usage();
+        }
+        return runScripts(argv + first, argc - first, jobs, budget,
+                          optLevel);
+    }
+
+    VM vm;
+    initVM(&vm);
+    vm.optLevel = optLevel;
+    if (emitPath != NULL) {
+        if (first != argc - 1) usage();
+        emitFile(&vm, argv[first]);
+    } else if (first == 1 && argc == 1) {
+        repl(&vm);
+    } else if (first == argc - 1) {
+        runFile(&vm, argv[first]);
     } else {
-        fprintf(stderr, "Usage: clox [path]\n");
-        exit(64);
+        usage();
     }
-    freeVM();
+    freeVM(&vm);
     return 0;
 }
 
-void repl() {
+void repl(VM* vm) {
     char line[1024];
     for (;;) {
         printf("> ");
@@ -32,37 +99,97 @@ void repl() {
             break;
         }
 
-        interpret(line);
-        freeVM();
+        interpret(vm, line);
+        // each line starts clean but keeps the stack and compile buffers
+        resetVM(vm);
     }
 }
 
-void runFile(const char* file) {}
-
-void testChunk() {
-    Chunk chunk;
-    initChunk(&chunk);
+static char* readFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+    fseek(file, 0L, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file);
 
-    int constant = addConstant(&chunk, NUMBER_VAL(1.2));
-    writeChunk(&chunk, OP_CONSTANT, 123);
-    writeChunk(&chunk, constant, 123);
-    constant = addConstant(&chunk, NUMBER_VAL(3.4));
-    writeChunk(&chunk, OP_CONSTANT, 123);
-    writeChunk(&chunk, constant, 123);
+    char* buffer = (char*)malloc(fileSize + 1);
+    if (buffer == NULL) {
+        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+        exit(74);
+    }
+    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+    if (bytesRead < fileSize) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
+        exit(74);
+    }
+    buffer[bytesRead] = '\0';
+    fclose(file);
+    return buffer;
+}
 
-    writeChunk(&chunk, OP_ADD, 123);
+static FILE* openReport(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+    return file;
+}
 
-    constant = addConstant(&chunk, NUMBER_VAL(5.6));
-    writeChunk(&chunk, OP_CONSTANT, 123);
-    writeChunk(&chunk, constant, 123);
+void runFile(VM* vm, const char* path) {
+    char* source = readFile(path);
+    if (sampleProfilePath != NULL &&
+        !startSampler(vm, path, SAMPLER_DEFAULT_HZ)) {
+        fprintf(stderr, "Could not start the sampling profiler.\n");
+        exit(74);
+    }
+    setBudget(vm, budget);
+    vm->borrowSource = true;
+    InterpretResult result = interpret(vm, source);
 
-    writeChunk(&chunk, OP_DIVIDE, 123);
+    if (sampleProfilePath != NULL) {
+        stopSampler();
+        FILE* file = openReport(sampleProfilePath);
+        writeCollapsedStacks(file);
+        fclose(file);
+        freeSampler();
+    }
+    if (statsPath != NULL) {
+        VMStats stats;
+        getVMStats(vm, &stats);
+        FILE* file = openReport(statsPath);
+        writeStatsJson(&stats, file);
+        fclose(file);
+    }
+    // the vm's strings point into source
+    resetVM(vm);
+    free(source);
 
-    writeChunk(&chunk, OP_NEGATE, 123);
-    writeChunk(&chunk, OP_RETURN, 123);
-    // disassembleChunk(&chunk, "test chunk");
+    if (result == INTERPRET_COMPILE_ERROR) exit(65);
+    if (result == INTERPRET_RUNTIME_ERROR) exit(70);
+    if (result == INTERPRET_BUDGET_EXHAUSTED) {
+        // the same status as timeout(1)
+        fprintf(stderr, "Script ran out of its budget.\n");
+        exit(124);
+    }
+}
 
-    // interpret(&chunk);
+void emitFile(VM* vm, const char* path) {
+    char* source = readFile(path);
+    Chunk chunk;
+    initChunk(&chunk);
+    if (!compile(vm, source, &chunk)) exit(65);
+    free(source);
 
+    FILE* file = openReport(emitPath);
+    bool emitted = emitC(&chunk, path, file);
+    fclose(file);
     freeChunk(&chunk);
-}
\ No newline at end of file
+    if (!emitted) {
+        fprintf(stderr, "Could not translate \"%s\" to C.\n", path);
+        exit(70);
+    }
+}
@@ -5,6 +5,7 @@
 
 #include "memory.h"
 #include "object.h"
+#include "probes.h"
 
 #define TABLE_MAX_LOAD 0.75
 
@@ -19,6 +20,14 @@ void freeMap(Map* map) {
     initMap(map);
 }
 
+void clearMap(Map* map) {
+    for (int i = 0; i < map->capacity; i++) {
+        map->entries[i].key = NULL;
+        map->entries[i].value = NIL_VAL;
+    }
+    map->count = 0;
+}
+
 static Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
     uint32_t index = key->hash % capacity;
     Entry* tombstone = NULL;
@@ -44,6 +53,7 @@ static Entry* findEntry(Entry* entries, int capacity, ObjString* key) {
 }
 
 static void adjustCapacity(Map* map, int capacity) {
+    PROBE3(map__resize, map, map->capacity, capacity);
     Entry* entries = ALLOCATE(Entry, capacity);
     for (int i = 0; i < capacity; i++) {
         entries[i].key = NULL;
@@ -94,6 +104,14 @@ void mapAddAll(Map* from, Map* to) {
     }
 }
 
+Entry* mapFindEntry(Map* map, ObjString* key) {
+    if (map->count == 0) {
+        return NULL;
+    }
+    Entry* entry = findEntry(map->entries, map->capacity, key);
+    return entry->key == NULL ? NULL : entry;
+}
+
 bool mapGet(Map* map, ObjString* key, Value* outValue) {
     if (map->count == 0) {
         return false;
@@ -122,7 +140,7 @@ bool mapDelete(Map* map, ObjString* key) {
     return true;
 }
 
-ObjString* mapFindString(Map* map, const char* chars, int length,
+ObjString* mapFindString(const Map* map, const char* chars, int length,
                          uint32_t hash) {
     if (map->count == 0) {
         return NULL;
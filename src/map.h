@@ -16,9 +16,13 @@ typedef struct {
 
 void initMap(Map* map);
 void freeMap(Map* map);
+// empties the map, keeping its capacity
+void clearMap(Map* map);
 bool mapSet(Map* map, ObjString* key, Value value);
 bool mapGet(Map* map, ObjString* key, Value* outValue);
 bool mapDelete(Map* map, ObjString* key);
-ObjString* mapFindString(Map* map, const char* chars, int length,
+// the entry holding key, NULL if there is none
+Entry* mapFindEntry(Map* map, ObjString* key);
+ObjString* mapFindString(const Map* map, const char* chars, int length,
                          uint32_t hash);
 #endif
\ No newline at end of file
@@ -3,12 +3,18 @@
 #include <stdlib.h>
 
 #include "object.h"
+#include "vm.h"
+
+_Thread_local size_t allocationCount = 0;
+_Thread_local size_t bytesAllocated = 0;
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
+    bytesAllocated += newSize - oldSize;
     if (newSize == 0) {
         free(pointer);
         return NULL;
     }
+    allocationCount++;
     void* result = realloc(pointer, newSize);
     if (result == NULL) {
         exit(1);
@@ -17,22 +23,41 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
     return result;
 }
 
-void freeObject(Obj* obj) {
+static void freeObject(Obj* obj, ObjectStats* objectStats) {
+    ObjectStats* stats = &objectStats[obj->type];
+    stats->live--;
     switch (obj->type) {
         case OBJ_STRING: {
             ObjString* objStr = (ObjString*)obj;
-            FREE_ARRAY(char, objStr->chars, objStr->length + 1);
-            FREE(OBJ_STRING, obj);
+            stats->bytesLive -= sizeof(ObjString);
+            if (objStr->ownsChars) {
+                stats->bytesLive -= objStr->length + 1;
+                FREE_ARRAY(char, objStr->chars, objStr->length + 1);
+            }
+            FREE(ObjString, obj);
+            break;
+        }
+        case OBJ_ARRAY: {
+            ObjArray* array = (ObjArray*)obj;
+            stats->bytesLive -= sizeof(ObjArray);
+            stats->bytesLive -= sizeof(double) * array->count;
+            FREE_ARRAY(double, array->values, array->count);
+            FREE(ObjArray, obj);
             break;
         }
     }
 }
 
-void freeObjects(Obj* root) {
-    Obj* obj = root;
+void freeObjectList(Obj* objects, ObjectStats* stats) {
+    Obj* obj = objects;
     while (obj != NULL) {
         Obj* next = obj->next;
-        freeObject(obj);
+        freeObject(obj, stats);
         obj = next;
     }
+}
+
+void freeObjects(VM* vm) {
+    freeObjectList(vm->objects, vm->objectStats);
+    vm->objects = NULL;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define clox_memory_h
 #include "common.h"
 #include "object.h"
+#include "stats.h"
 
 #define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
 
@@ -13,7 +14,14 @@
     reallocate(pointer, sizeof(type) * (oldCount), 0)
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+
+// running totals kept by reallocate(), per thread so that vms on
+// different threads don't race on them
+extern _Thread_local size_t allocationCount;
+extern _Thread_local size_t bytesAllocated;
 #define ALLOCATE(type, count) (type*)reallocate(NULL, 0, sizeof(type) * (count))
 #define FREE(type, ptr) reallocate((ptr), sizeof(type), 0)
-void freeObjects(Obj* root);
+void freeObjects(VM* vm);
+// frees objects linked through next, keeping stats up to date
+void freeObjectList(Obj* objects, ObjectStats* stats);
 #endif
\ No newline at end of file
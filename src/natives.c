@@ -0,0 +1,137 @@
+#include "natives.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include "array.h"
+
+static const char* expectArray(Value value) {
+    return IS_ARRAY(value) ? NULL : "Argument must be an array.";
+}
+
+// both arrays and of the same length
+static const char* expectArrays(Value a, Value b) {
+    if (!IS_ARRAY(a) || !IS_ARRAY(b)) return "Arguments must be arrays.";
+    if (AS_ARRAY(a)->count != AS_ARRAY(b)->count) {
+        return "Arrays differ in length.";
+    }
+    return NULL;
+}
+
+// array(n), n zeros
+static const char* arrayNative(VM* vm, Value* args, Value* result) {
+    if (!IS_NUMBER(args[0])) return "Array length must be a number.";
+    double count = AS_NUMBER(args[0]);
+    // false for nan as well
+    if (!(count >= 0 && count <= INT_MAX) || count != (int)count) {
+        return "Array length must be a whole number, 0 or more.";
+    }
+    *result = OBJ_VAL(newArray(vm, (int)count));
+    return NULL;
+}
+
+static const char* lengthNative(VM* vm, Value* args, Value* result) {
+    (void)vm;
+    const char* error = expectArray(args[0]);
+    if (error != NULL) return error;
+    *result = NUMBER_VAL(AS_ARRAY(args[0])->count);
+    return NULL;
+}
+
+static const char* sumNative(VM* vm, Value* args, Value* result) {
+    (void)vm;
+    const char* error = expectArray(args[0]);
+    if (error != NULL) return error;
+    ObjArray* array = AS_ARRAY(args[0]);
+    *result = NUMBER_VAL(arraySum(array->values, array->count));
+    return NULL;
+}
+
+static const char* dotNative(VM* vm, Value* args, Value* result) {
+    (void)vm;
+    const char* error = expectArrays(args[0], args[1]);
+    if (error != NULL) return error;
+    ObjArray* a = AS_ARRAY(args[0]);
+    ObjArray* b = AS_ARRAY(args[1]);
+    *result = NUMBER_VAL(arrayDot(a->values, b->values, a->count));
+    return NULL;
+}
+
+// scale(a, k) multiplies a by k in place and returns it
+static const char* scaleNative(VM* vm, Value* args, Value* result) {
+    (void)vm;
+    const char* error = expectArray(args[0]);
+    if (error != NULL) return error;
+    if (!IS_NUMBER(args[1])) return "Scale must be a number.";
+    ObjArray* array = AS_ARRAY(args[0]);
+    arrayScale(array->values, array->count, AS_NUMBER(args[1]));
+    *result = args[0];
+    return NULL;
+}
+
+// add(a, b) adds b to a in place and returns a
+static const char* addNative(VM* vm, Value* args, Value* result) {
+    (void)vm;
+    const char* error = expectArrays(args[0], args[1]);
+    if (error != NULL) return error;
+    ObjArray* a = AS_ARRAY(args[0]);
+    arrayAdd(a->values, AS_ARRAY(args[1])->values, a->count);
+    *result = args[0];
+    return NULL;
+}
+
+// min(a) and max(a) are nil for an empty array
+static const char* minNative(VM* vm, Value* args, Value* result) {
+    (void)vm;
+    const char* error = expectArray(args[0]);
+    if (error != NULL) return error;
+    ObjArray* array = AS_ARRAY(args[0]);
+    *result = array->count == 0
+                  ? NIL_VAL
+                  : NUMBER_VAL(arrayMin(array->values, array->count));
+    return NULL;
+}
+
+static const char* maxNative(VM* vm, Value* args, Value* result) {
+    (void)vm;
+    const char* error = expectArray(args[0]);
+    if (error != NULL) return error;
+    ObjArray* array = AS_ARRAY(args[0]);
+    *result = array->count == 0
+                  ? NIL_VAL
+                  : NUMBER_VAL(arrayMax(array->values, array->count));
+    return NULL;
+}
+
+const Native natives[] = {
+    {"array", 1, arrayNative},
+    {"length", 1, lengthNative},
+    {"sum", 1, sumNative},
+    {"dot", 2, dotNative},
+    {"scale", 2, scaleNative},
+    {"add", 2, addNative},
+    {"min", 1, minNative},
+    {"max", 1, maxNative},
+    {NULL, 0, NULL},
+};
+
+int findNative(const char* name, int length) {
+    for (int i = 0; natives[i].name != NULL; i++) {
+        if ((int)strlen(natives[i].name) == length &&
+            memcmp(natives[i].name, name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* callNative(VM* vm, int index, Value** top) {
+    const Native* native = &natives[index];
+    Value* args = *top - native->arity;
+    Value result;
+    const char* error = native->function(vm, args, &result);
+    if (error != NULL) return error;
+    args[0] = result;
+    *top = args + 1;
+    return NULL;
+}
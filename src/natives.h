@@ -0,0 +1,31 @@
+#ifndef clox_natives_h
+#define clox_natives_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+// the functions built into the language, called as name(arguments).
+// there are no function values, so the compiler resolves a call to its
+// native and OP_NATIVE names it by its index in natives.
+typedef const char* (*NativeFn)(VM* vm, Value* args, Value* result);
+
+typedef struct {
+    const char* name;
+    int arity;
+    // sets *result from the arity values at args. NULL, or the message
+    // of the runtime error it failed with.
+    NativeFn function;
+} Native;
+
+extern const Native natives[];
+
+// the index of the native named by the length bytes at name, -1 if
+// there is none
+int findNative(const char* name, int length);
+// calls native index on the arguments at the top of the stack that ends
+// at *top and replaces them with its result. NULL, or the message of the
+// runtime error it failed with.
+const char* callNative(VM* vm, int index, Value** top);
+
+#endif
@@ -0,0 +1,401 @@
+#include "number.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// every power of ten up to 1e22 is exact as a double
+static const double exactPowersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define MAX_EXACT_MANTISSA (1ull << 53)
+#define MAX_EXACT_POWER 22
+#define MAX_MANTISSA_DIGITS 19
+
+static double parseSlow(const char* start, int length) {
+    char buffer[64];
+    char* text = buffer;
+    if (length >= (int)sizeof(buffer)) {
+        text = malloc(length + 1);
+    }
+    memcpy(text, start, length);
+    text[length] = '\0';
+    double value = strtod(text, NULL);
+    if (text != buffer) {
+        free(text);
+    }
+    return value;
+}
+
+// Clinger's fast path: when the decimal digits fit in 53 bits and the
+// power of ten is exact, a single correctly rounded multiply or divide
+// gives the correctly rounded result. everything else goes to strtod.
+double parseNumber(const char* start, int length) {
+    const char* p = start;
+    const char* end = start + length;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0) digits++;
+        } else {
+            exponent++;
+        }
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0) digits++;
+                exponent--;
+            }
+            p++;
+        }
+    }
+
+    if (p != end || digits >= MAX_MANTISSA_DIGITS ||
+        mantissa > MAX_EXACT_MANTISSA) {
+        return parseSlow(start, length);
+    }
+    if (exponent == 0) {
+        return (double)mantissa;
+    }
+    if (exponent > 0 && exponent <= MAX_EXACT_POWER) {
+        return (double)mantissa * exactPowersOfTen[exponent];
+    }
+    if (exponent < 0 && -exponent <= MAX_EXACT_POWER) {
+        return (double)mantissa / exactPowersOfTen[-exponent];
+    }
+    return parseSlow(start, length);
+}
+
+
+// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers"). it always produces digits that read back
+// to the same double and almost always the shortest such digits.
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define SIGNIFICAND_MASK 0x000fffffffffffffull
+#define HIDDEN_BIT 0x0010000000000000ull
+#define EXPONENT_BIAS 1075
+
+// normalized 10^k for k = -348, -340, ..., 340
+static const DiyFp cachedPowers[] = {
+    {0xfa8fd5a0081c0288ull, -1220},
+    {0xbaaee17fa23ebf76ull, -1193},
+    {0x8b16fb203055ac76ull, -1166},
+    {0xcf42894a5dce35eaull, -1140},
+    {0x9a6bb0aa55653b2dull, -1113},
+    {0xe61acf033d1a45dfull, -1087},
+    {0xab70fe17c79ac6caull, -1060},
+    {0xff77b1fcbebcdc4full, -1034},
+    {0xbe5691ef416bd60cull, -1007},
+    {0x8dd01fad907ffc3cull, -980},
+    {0xd3515c2831559a83ull, -954},
+    {0x9d71ac8fada6c9b5ull, -927},
+    {0xea9c227723ee8bcbull, -901},
+    {0xaecc49914078536dull, -874},
+    {0x823c12795db6ce57ull, -847},
+    {0xc21094364dfb5637ull, -821},
+    {0x9096ea6f3848984full, -794},
+    {0xd77485cb25823ac7ull, -768},
+    {0xa086cfcd97bf97f4ull, -741},
+    {0xef340a98172aace5ull, -715},
+    {0xb23867fb2a35b28eull, -688},
+    {0x84c8d4dfd2c63f3bull, -661},
+    {0xc5dd44271ad3cdbaull, -635},
+    {0x936b9fcebb25c996ull, -608},
+    {0xdbac6c247d62a584ull, -582},
+    {0xa3ab66580d5fdaf6ull, -555},
+    {0xf3e2f893dec3f126ull, -529},
+    {0xb5b5ada8aaff80b8ull, -502},
+    {0x87625f056c7c4a8bull, -475},
+    {0xc9bcff6034c13053ull, -449},
+    {0x964e858c91ba2655ull, -422},
+    {0xdff9772470297ebdull, -396},
+    {0xa6dfbd9fb8e5b88full, -369},
+    {0xf8a95fcf88747d94ull, -343},
+    {0xb94470938fa89bcfull, -316},
+    {0x8a08f0f8bf0f156bull, -289},
+    {0xcdb02555653131b6ull, -263},
+    {0x993fe2c6d07b7facull, -236},
+    {0xe45c10c42a2b3b06ull, -210},
+    {0xaa242499697392d3ull, -183},
+    {0xfd87b5f28300ca0eull, -157},
+    {0xbce5086492111aebull, -130},
+    {0x8cbccc096f5088ccull, -103},
+    {0xd1b71758e219652cull, -77},
+    {0x9c40000000000000ull, -50},
+    {0xe8d4a51000000000ull, -24},
+    {0xad78ebc5ac620000ull, 3},
+    {0x813f3978f8940984ull, 30},
+    {0xc097ce7bc90715b3ull, 56},
+    {0x8f7e32ce7bea5c70ull, 83},
+    {0xd5d238a4abe98068ull, 109},
+    {0x9f4f2726179a2245ull, 136},
+    {0xed63a231d4c4fb27ull, 162},
+    {0xb0de65388cc8ada8ull, 189},
+    {0x83c7088e1aab65dbull, 216},
+    {0xc45d1df942711d9aull, 242},
+    {0x924d692ca61be758ull, 269},
+    {0xda01ee641a708deaull, 295},
+    {0xa26da3999aef774aull, 322},
+    {0xf209787bb47d6b85ull, 348},
+    {0xb454e4a179dd1877ull, 375},
+    {0x865b86925b9bc5c2ull, 402},
+    {0xc83553c5c8965d3dull, 428},
+    {0x952ab45cfa97a0b3ull, 455},
+    {0xde469fbd99a05fe3ull, 481},
+    {0xa59bc234db398c25ull, 508},
+    {0xf6c69a72a3989f5cull, 534},
+    {0xb7dcbf5354e9beceull, 561},
+    {0x88fcf317f22241e2ull, 588},
+    {0xcc20ce9bd35c78a5ull, 614},
+    {0x98165af37b2153dfull, 641},
+    {0xe2a0b5dc971f303aull, 667},
+    {0xa8d9d1535ce3b396ull, 694},
+    {0xfb9b7cd9a4a7443cull, 720},
+    {0xbb764c4ca7a44410ull, 747},
+    {0x8bab8eefb6409c1aull, 774},
+    {0xd01fef10a657842cull, 800},
+    {0x9b10a4e5e9913129ull, 827},
+    {0xe7109bfba19c0c9dull, 853},
+    {0xac2820d9623bf429ull, 880},
+    {0x80444b5e7aa7cf85ull, 907},
+    {0xbf21e44003acdd2dull, 933},
+    {0x8e679c2f5e44ff8full, 960},
+    {0xd433179d9c8cb841ull, 986},
+    {0x9e19db92b4e31ba9ull, 1013},
+    {0xeb96bf6ebadf77d9ull, 1039},
+    {0xaf87023b9bf0ee6bull, 1066},
+};
+
+static const uint64_t powersOfTen[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+static DiyFp multiply(DiyFp a, DiyFp b) {
+    unsigned __int128 p = (unsigned __int128)a.f * b.f;
+    uint64_t h = (uint64_t)(p >> 64);
+    // round on the highest dropped bit
+    h += (uint64_t)(p >> 63) & 1;
+    return (DiyFp){h, a.e + b.e + 64};
+}
+
+static DiyFp normalize(DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+    return (DiyFp){x.f << shift, x.e - shift};
+}
+
+static DiyFp cachedPower(int e, int* k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - ik > 0.0) ik++;
+    int index = (ik >> 3) + 1;
+    *k = -(-348 + index * 8);
+    return cachedPowers[index];
+}
+
+static int countDigits(uint32_t n) {
+    int digits = 1;
+    while (n >= 10) {
+        n /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+static void roundDigit(char* buffer, int length, uint64_t delta,
+                       uint64_t rest, uint64_t tenKappa, uint64_t distance) {
+    while (rest < distance && delta - rest >= tenKappa &&
+           (rest + tenKappa < distance ||
+            distance - rest > rest + tenKappa - distance)) {
+        buffer[length - 1]--;
+        rest += tenKappa;
+    }
+}
+
+static int generateDigits(DiyFp w, DiyFp upper, uint64_t delta, char* buffer,
+                          int* k) {
+    DiyFp one = {1ull << -upper.e, upper.e};
+    uint64_t distance = upper.f - w.f;
+    uint32_t p1 = (uint32_t)(upper.f >> -one.e);
+    uint64_t p2 = upper.f & (one.f - 1);
+    int kappa = countDigits(p1);
+    int length = 0;
+
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)powersOfTen[kappa - 1];
+        uint32_t digit = p1 / divisor;
+        p1 %= divisor;
+        if (digit != 0 || length != 0) buffer[length++] = (char)('0' + digit);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            roundDigit(buffer, length, delta, rest,
+                       powersOfTen[kappa] << -one.e, distance);
+            return length;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char digit = (char)(p2 >> -one.e);
+        if (digit != 0 || length != 0) buffer[length++] = (char)('0' + digit);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            roundDigit(buffer, length, delta, p2, one.f,
+                       distance * (index < 20 ? powersOfTen[index] : 0));
+            return length;
+        }
+    }
+}
+
+// writes the digits of a positive, finite, non zero value and sets k so
+// that value = digits * 10^k
+static int grisu2(double value, char* buffer, int* k) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int biasedExponent = (int)(bits >> 52);
+    uint64_t significand = bits & SIGNIFICAND_MASK;
+    DiyFp v;
+    if (biasedExponent != 0) {
+        v = (DiyFp){significand + HIDDEN_BIT, biasedExponent - EXPONENT_BIAS};
+    } else {
+        v = (DiyFp){significand, 1 - EXPONENT_BIAS};
+    }
+
+    // the boundaries halfway to the neighbouring doubles
+    DiyFp plus = normalize((DiyFp){(v.f << 1) + 1, v.e - 1});
+    DiyFp minus = v.f == HIDDEN_BIT ? (DiyFp){(v.f << 2) - 1, v.e - 2}
+                                    : (DiyFp){(v.f << 1) - 1, v.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    DiyFp power = cachedPower(plus.e, k);
+    DiyFp w = multiply(normalize(v), power);
+    DiyFp upper = multiply(plus, power);
+    DiyFp lower = multiply(minus, power);
+    lower.f++;
+    upper.f--;
+    return generateDigits(w, upper, upper.f - lower.f, buffer, k);
+}
+
+static int writeExponent(int exponent, char* buffer) {
+    int length = 0;
+    buffer[length++] = 'e';
+    buffer[length++] = exponent < 0 ? '-' : '+';
+    if (exponent < 0) exponent = -exponent;
+    char digits[4];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + exponent % 10);
+        exponent /= 10;
+    } while (exponent != 0);
+    while (count > 0) buffer[length++] = digits[--count];
+    return length;
+}
+
+// lays the digits out the way javascript prints numbers: plain notation
+// for magnitudes in [1e-6, 1e21), exponent notation outside of it
+static int prettify(char* buffer, int length, int k) {
+    int kk = length + k;  // 10^(kk - 1) <= value < 10^kk
+    if (k >= 0 && kk <= 21) {
+        // 1234e7 -> 12340000000
+        memset(buffer + length, '0', k);
+        return kk;
+    }
+    if (kk > 0 && kk <= 21) {
+        // 1234e-2 -> 12.34
+        memmove(buffer + kk + 1, buffer + kk, length - kk);
+        buffer[kk] = '.';
+        return length + 1;
+    }
+    if (kk > -6 && kk <= 0) {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(buffer + offset, buffer, length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        memset(buffer + 2, '0', offset - 2);
+        return length + offset;
+    }
+    if (length == 1) {
+        // 1e30
+        return 1 + writeExponent(kk - 1, buffer + 1);
+    }
+    // 1234e30 -> 1.234e+33
+    memmove(buffer + 2, buffer + 1, length - 1);
+    buffer[1] = '.';
+    return length + 1 + writeExponent(kk - 1, buffer + length + 1);
+}
+
+static int formatInteger(uint64_t n, char* buffer) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    for (int i = 0; i < count; i++) {
+        buffer[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+int formatNumber(double value, char* buffer) {
+    if (value != value) {
+        memcpy(buffer, "nan", 3);
+        return 3;
+    }
+    int length = 0;
+    if (signbit(value)) {
+        buffer[length++] = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        memcpy(buffer + length, "inf", 3);
+        return length + 3;
+    }
+    // integers are by far the most common thing we print
+    if (value < 9007199254740992.0 && value == (double)(uint64_t)value) {
+        return length + formatInteger((uint64_t)value, buffer + length);
+    }
+    int k;
+    int digits = grisu2(value, buffer + length, &k);
+    return length + prettify(buffer + length, digits, k);
+}
@@ -0,0 +1,15 @@
+#ifndef clox_number_h
+#define clox_number_h
+#include "common.h"
+
+// parses a number literal of exactly length bytes, the text doesn't need
+// to be terminated
+double parseNumber(const char* start, int length);
+
+#define NUMBER_BUFFER_SIZE 32
+
+// writes the shortest digits that read back as the same double, returns
+// the number of bytes written. the result is not terminated.
+int formatNumber(double value, char* buffer);
+
+#endif
@@ -2,35 +2,47 @@
 
 #include <string.h>
 
+#include "intern.h"
 #include "memory.h"
+#include "probes.h"
 #include "vm.h"
 
-extern VM vm;
-
-static Obj *allocateObject(size_t size, ObjType type) {
+static Obj *allocateObject(VM *vm, size_t size, ObjType type) {
+    PROBE2(object__alloc, type, size);
     Obj *obj = (Obj *)reallocate(NULL, 0, size);
     obj->type = type;
+    ObjectStats *stats = &vm->objectStats[type];
+    stats->allocated++;
+    stats->live++;
+    stats->bytesAllocated += size;
+    stats->bytesLive += size;
 
     // keep a linked list of objects
-    obj->next = vm.objects;
-    vm.objects = obj;
+    obj->next = vm->objects;
+    vm->objects = obj;
 
     return obj;
 }
 
-#define ALLOCATE_OBJ(type, objectType) \
-    (type *)allocateObject(sizeof(type), objectType)
+#define ALLOCATE_OBJ(vm, type, objectType) \
+    (type *)allocateObject(vm, sizeof(type), objectType)
 
-ObjString *allocateString(char *chars, int length, uint32_t hash) {
-    ObjString *objString = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+static ObjString *allocateString(VM *vm, char *chars, int length,
+                                 uint32_t hash, bool ownsChars) {
+    ObjString *objString = ALLOCATE_OBJ(vm, ObjString, OBJ_STRING);
     objString->length = length;
     objString->chars = chars;
     objString->hash = hash;
-    mapSet(&vm.strings, objString, NIL_VAL);
+    objString->ownsChars = ownsChars;
+    if (ownsChars) {
+        vm->objectStats[OBJ_STRING].bytesAllocated += length + 1;
+        vm->objectStats[OBJ_STRING].bytesLive += length + 1;
+    }
+    mapSet(&vm->strings, objString, NIL_VAL);
     return objString;
 }
 
-static uint32_t hashString(const char *key, int length) {
+uint32_t hashString(const char *key, int length) {
     uint32_t hash = 2166136261u;
     for (int i = 0; i < length; i++) {
         hash ^= (uint8_t)key[i];
@@ -39,21 +51,87 @@ static uint32_t hashString(const char *key, int length) {
     return hash;
 }
 
-ObjString *copyString(const char *chars, int length) {
+// immortal strings shared by every vm, nothing links them into a vm's
+// object list
+static ObjString *allocateSharedString(char *chars, int length,
+                                       uint32_t hash) {
+    ObjString *string = (ObjString *)reallocate(NULL, 0, sizeof(ObjString));
+    string->obj.type = OBJ_STRING;
+    string->obj.next = NULL;
+    string->length = length;
+    string->chars = chars;
+    string->hash = hash;
+    string->ownsChars = true;
+    ObjString *shared = addSharedString(string);
+    if (shared != string) {
+        // another thread added it first
+        FREE_ARRAY(char, chars, length + 1);
+        FREE(ObjString, string);
+    }
+    return shared;
+}
+
+static ObjString *newString(VM *vm, char *chars, int length, uint32_t hash) {
+    if (vm->internShared) return allocateSharedString(chars, length, hash);
+    return allocateString(vm, chars, length, hash, true);
+}
+
+// the vm's own strings come first. it may have made its copy before an
+// equal string was added to the shared table, and has to keep using it.
+static ObjString *findInterned(VM *vm, const char *chars, int length,
+                               uint32_t hash) {
+    ObjString *local = mapFindString(&vm->strings, chars, length, hash);
+    if (local != NULL) return local;
+    return findSharedString(chars, length, hash);
+}
+
+ObjString *copyString(VM *vm, const char *chars, int length) {
     uint32_t hash = hashString(chars, length);
-    ObjString *interned = mapFindString(&vm.strings, chars, length, hash);
+    ObjString *interned = findInterned(vm, chars, length, hash);
     if (interned != NULL) {
+        PROBE2(string__intern__hit, chars, length);
         return interned;
     }
+    PROBE2(string__intern__miss, chars, length);
 
     char *heapChars = ALLOCATE(char, length + 1);
     memcpy(heapChars, chars, length);
     heapChars[length] = '\0';
 
-    return allocateString(heapChars, length, hash);
+    return newString(vm, heapChars, length, hash);
 }
 
-ObjString *takeString(const char *chars, int length) {
+ObjString *takeString(VM *vm, char *chars, int length) {
     uint32_t hash = hashString(chars, length);
-    return allocateString(chars, length, hash);
-}
\ No newline at end of file
+    ObjString *interned = findInterned(vm, chars, length, hash);
+    if (interned != NULL) {
+        PROBE2(string__intern__hit, chars, length);
+        FREE_ARRAY(char, chars, length + 1);
+        return interned;
+    }
+    PROBE2(string__intern__miss, chars, length);
+    return newString(vm, chars, length, hash);
+}
+
+ObjString *borrowString(VM *vm, const char *chars, int length) {
+    // shared strings outlive any one source
+    if (vm->internShared) return copyString(vm, chars, length);
+    uint32_t hash = hashString(chars, length);
+    ObjString *interned = findInterned(vm, chars, length, hash);
+    if (interned != NULL) {
+        PROBE2(string__intern__hit, chars, length);
+        return interned;
+    }
+    PROBE2(string__intern__miss, chars, length);
+    return allocateString(vm, (char *)chars, length, hash, false);
+}
+
+ObjArray *newArray(VM *vm, int count) {
+    ObjArray *array = ALLOCATE_OBJ(vm, ObjArray, OBJ_ARRAY);
+    array->count = count;
+    array->values = ALLOCATE(double, count);
+    if (count > 0) memset(array->values, 0, sizeof(double) * count);
+    vm->objectStats[OBJ_ARRAY].bytesAllocated += sizeof(double) * count;
+    vm->objectStats[OBJ_ARRAY].bytesLive += sizeof(double) * count;
+    return array;
+}
@@ -6,8 +6,14 @@
 
 typedef enum {
     OBJ_STRING,
+    OBJ_ARRAY,
 } ObjType;
 
+#define OBJ_TYPE_COUNT (OBJ_ARRAY + 1)
+
+// objects belong to the vm that allocated them
+typedef struct VM VM;
+
 struct Obj {
     ObjType type;
     struct Obj *next;
@@ -18,18 +24,38 @@ struct ObjString {
     int length;
     char *chars;
     uint32_t hash;
+    // false when chars point into a source, see borrowString()
+    bool ownsChars;
+};
+
+// a fixed number of doubles, stored contiguously so that the bulk
+// operations in array.h can run over them with vector instructions
+struct ObjArray {
+    Obj obj;
+    int count;
+    double *values;
 };
 
 static inline bool isObjType(Value value, ObjType type) {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
-ObjString *copyString(const char *chars, int length);
-ObjString *takeString(const char *chars, int length);
+// the hash strings are interned by
+uint32_t hashString(const char *key, int length);
+ObjString *copyString(VM *vm, const char *chars, int length);
+ObjString *takeString(VM *vm, char *chars, int length);
+// like copyString(), but a new string points at chars instead of a copy,
+// so they have to outlive it and aren't nul terminated. strings shared
+// between vms are copied anyway.
+ObjString *borrowString(VM *vm, const char *chars, int length);
+// an array of count zeros
+ObjArray *newArray(VM *vm, int count);
 
 #define OBJ_TYPE(value) (AS_OBJ(value)->type)
 #define IS_STRING(value) isObjType(value, OBJ_STRING)
+#define IS_ARRAY(value) isObjType(value, OBJ_ARRAY)
 
 #define AS_STRING(value) ((ObjString *)AS_OBJ(value))
 #define AS_CSTRING(value) (((ObjString *)AS_OBJ(value))->chars)
+#define AS_ARRAY(value) ((ObjArray *)AS_OBJ(value))
 #endif
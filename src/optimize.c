@@ -0,0 +1,830 @@
+#include "optimize.h"
+
+#include <string.h>
+
+#include "ir.h"
+#include "object.h"
+
+// the passes run again while any of them still changes something
+#define MAX_ROUNDS 8
+
+static bool isLiteral(const IrNode* node) {
+    return node->op == OP_CONSTANT || node->op == OP_NIL ||
+           node->op == OP_TRUE || node->op == OP_FALSE;
+}
+
+static Value literalValue(const Ir* ir, const IrNode* node) {
+    switch (node->op) {
+        case OP_NIL:
+            return NIL_VAL;
+        case OP_TRUE:
+            return BOOL_VAL(true);
+        case OP_FALSE:
+            return BOOL_VAL(false);
+        default:
+            return ir->chunk->constants.values[node->operand];
+    }
+}
+
+static bool sameValue(Value a, Value b) {
+    return a.type == b.type && memcmp(&a.as, &b.as, sizeof(a.as)) == 0;
+}
+
+static bool isFalseyLiteral(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// turns node into a literal, false if a number doesn't fit in the
+// constant table any more
+static bool setLiteral(Ir* ir, IrNode* node, Value value) {
+    if (IS_NUMBER(value)) {
+        int constant = irConstant(ir, value);
+        if (constant < 0) return false;
+        node->op = OP_CONSTANT;
+        node->operand = constant;
+    } else if (IS_BOOL(value)) {
+        node->op = AS_BOOL(value) ? OP_TRUE : OP_FALSE;
+    } else {
+        node->op = OP_NIL;
+    }
+    node->left = -1;
+    node->right = -1;
+    return true;
+}
+
+// evaluating it can't fail and changes nothing
+static bool isPure(const Ir* ir, int index) {
+    const IrNode* node = &ir->nodes[index];
+    switch (node->op) {
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_LOCAL:
+            return false;
+        case OP_NEGATE: {
+            // a runtime error for anything but a number
+            const IrNode* operand = &ir->nodes[node->left];
+            return isLiteral(operand) &&
+                   IS_NUMBER(literalValue(ir, operand));
+        }
+        case OP_ADD: {
+            // a runtime error unless both are numbers or both strings
+            const IrNode* left = &ir->nodes[node->left];
+            const IrNode* right = &ir->nodes[node->right];
+            if (!isLiteral(left) || !isLiteral(right)) return false;
+            Value a = literalValue(ir, left);
+            Value b = literalValue(ir, right);
+            return (IS_NUMBER(a) && IS_NUMBER(b)) ||
+                   (IS_STRING(a) && IS_STRING(b));
+        }
+        default:
+            return (node->left < 0 || isPure(ir, node->left)) &&
+                   (node->right < 0 || isPure(ir, node->right));
+    }
+}
+
+static bool fallsThrough(const IrStatement* statement) {
+    return statement->kind != IR_LOOP && statement->kind != IR_RETURN;
+}
+
+static bool isJump(const IrStatement* statement) {
+    return statement->kind == IR_BRANCH || statement->kind == IR_LOOP;
+}
+
+static void removeStatement(IrStatement* statement) {
+    statement->kind = IR_NOP;
+    statement->expr = -1;
+}
+
+// the stack depth before each statement, and after the last one
+static void computeDepths(const Ir* ir, int* depths) {
+    int* arrivals = ARENA_ALLOCATE(ir->arena, int, ir->count + 1);
+    for (int i = 0; i <= ir->count; i++) arrivals[i] = -1;
+    int depth = 0;
+    for (int i = 0; i < ir->count; i++) {
+        const IrStatement* statement = &ir->statements[i];
+        if (arrivals[i] >= 0) depth = arrivals[i];
+        depths[i] = depth;
+        if (statement->kind == IR_PUSH || statement->kind == IR_BRANCH) {
+            depth++;
+        } else if (statement->kind == IR_DROP) {
+            depth -= statement->operand;
+        }
+        if (statement->kind == IR_BRANCH) arrivals[statement->target] = depth;
+    }
+    depths[ir->count] = depth;
+}
+
+// what is known about the value in a slot
+typedef enum {
+    FACT_UNKNOWN,
+    // the literal node op and operand describe
+    FACT_LITERAL,
+    // the same value as slot operand
+    FACT_COPY,
+} FactKind;
+
+typedef struct {
+    FactKind kind;
+    uint8_t op;
+    int operand;
+} Fact;
+
+static const Fact unknownFact = {FACT_UNKNOWN, 0, 0};
+
+typedef struct {
+    Ir* ir;
+    Fact facts[UINT8_COUNT];
+    bool rewrite;
+    int changes;
+} Propagation;
+
+static bool sameFact(const Ir* ir, Fact a, Fact b) {
+    if (a.kind != b.kind) return false;
+    if (a.kind == FACT_COPY) return a.operand == b.operand;
+    if (a.kind == FACT_UNKNOWN) return true;
+    IrNode x = {a.op, a.operand, -1, -1, 0};
+    IrNode y = {b.op, b.operand, -1, -1, 0};
+    return sameValue(literalValue(ir, &x), literalValue(ir, &y));
+}
+
+// forgets slot and everything known to be a copy of it
+static void clearSlot(Propagation* p, int slot) {
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        if (p->facts[i].kind == FACT_COPY && p->facts[i].operand == slot) {
+            p->facts[i] = unknownFact;
+        }
+    }
+    p->facts[slot] = unknownFact;
+}
+
+static void assign(Propagation* p, int slot, Fact fact) {
+    // storing a slot's own value changes nothing
+    if (fact.kind == FACT_COPY && fact.operand == slot) return;
+    clearSlot(p, slot);
+    p->facts[slot] = fact;
+}
+
+static Fact factOf(Propagation* p, int index) {
+    IrNode* node = &p->ir->nodes[index];
+    if (isLiteral(node)) {
+        return (Fact){FACT_LITERAL, node->op, node->operand};
+    }
+    if (node->op == OP_GET_LOCAL) {
+        Fact fact = p->facts[node->operand];
+        if (fact.kind != FACT_UNKNOWN) return fact;
+        return (Fact){FACT_COPY, OP_GET_LOCAL, node->operand};
+    }
+    if (node->op == OP_SET_LOCAL) return factOf(p, node->left);
+    return unknownFact;
+}
+
+static double arithmetic(uint8_t op, double a, double b) {
+    switch (op) {
+        case OP_ADD:
+            return a + b;
+        case OP_SUBTRACT:
+            return a - b;
+        case OP_MULTIPLY:
+            return a * b;
+        default:
+            return a / b;
+    }
+}
+
+// computes node now if its operands are literals
+static void fold(Propagation* p, int index) {
+    Ir* ir = p->ir;
+    IrNode* node = &ir->nodes[index];
+    if (node->left < 0 || !isLiteral(&ir->nodes[node->left])) return;
+    Value a = literalValue(ir, &ir->nodes[node->left]);
+    Value b = NIL_VAL;
+    if (node->right >= 0) {
+        if (!isLiteral(&ir->nodes[node->right])) return;
+        b = literalValue(ir, &ir->nodes[node->right]);
+    }
+
+    Value result;
+    switch (node->op) {
+        case OP_NEGATE:
+            if (!IS_NUMBER(a)) return;
+            result = NUMBER_VAL(-AS_NUMBER(a));
+            break;
+        case OP_NOT:
+            result = BOOL_VAL(isFalseyLiteral(a));
+            break;
+        case OP_EQUAL:
+            result = BOOL_VAL(valuesEqual(a, b));
+            break;
+        case OP_LESS:
+        case OP_GREATER:
+            if (!IS_NUMBER(a) || !IS_NUMBER(b)) return;
+            result = BOOL_VAL(node->op == OP_LESS
+                                  ? AS_NUMBER(a) < AS_NUMBER(b)
+                                  : AS_NUMBER(a) > AS_NUMBER(b));
+            break;
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+            // strings are left alone, joining them needs a vm
+            if (!IS_NUMBER(a) || !IS_NUMBER(b)) return;
+            result = NUMBER_VAL(
+                arithmetic(node->op, AS_NUMBER(a), AS_NUMBER(b)));
+            break;
+        default:
+            return;
+    }
+    if (setLiteral(ir, node, result)) p->changes++;
+}
+
+// visits the tree in the order it is evaluated
+static void propagateNode(Propagation* p, int index) {
+    IrNode* node = &p->ir->nodes[index];
+    switch (node->op) {
+        case OP_GET_LOCAL: {
+            Fact fact = p->facts[node->operand];
+            if (!p->rewrite || fact.kind == FACT_UNKNOWN) break;
+            node->op = fact.op;
+            node->operand = fact.operand;
+            p->changes++;
+            break;
+        }
+        case OP_SET_LOCAL:
+            propagateNode(p, node->left);
+            assign(p, node->operand, factOf(p, node->left));
+            break;
+        default:
+            if (node->left >= 0) propagateNode(p, node->left);
+            if (node->right >= 0) propagateNode(p, node->right);
+            if (p->rewrite) fold(p, index);
+            break;
+    }
+}
+
+static void propagateStatement(Propagation* p, IrStatement* statement,
+                               int depth) {
+    if (statement->expr >= 0) propagateNode(p, statement->expr);
+    switch (statement->kind) {
+        case IR_PUSH: {
+            Fact fact = factOf(p, statement->expr);
+            clearSlot(p, depth);
+            p->facts[depth] = fact;
+            break;
+        }
+        case IR_BRANCH:
+            clearSlot(p, depth);
+            break;
+        case IR_DROP:
+            for (int i = 1; i <= statement->operand; i++) {
+                clearSlot(p, depth - i);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// the facts on entry to each jump target, met over every way in
+typedef struct {
+    int* index;
+    Fact* facts;
+    bool* seen;
+    int count;
+} Entries;
+
+static bool meet(const Ir* ir, Entries* entries, int statement,
+                 const Fact* facts) {
+    int at = entries->index[statement];
+    Fact* entry = &entries->facts[at * UINT8_COUNT];
+    if (!entries->seen[at]) {
+        memcpy(entry, facts, sizeof(Fact) * UINT8_COUNT);
+        entries->seen[at] = true;
+        return true;
+    }
+    bool changed = false;
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        if (entry[i].kind != FACT_UNKNOWN &&
+            !sameFact(ir, entry[i], facts[i])) {
+            entry[i] = unknownFact;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// one pass over the statements. without rewrite it only updates the
+// entry facts and says whether they changed.
+static bool sweep(Propagation* p, Entries* entries, const int* depths) {
+    Ir* ir = p->ir;
+    bool changed = false;
+    bool reachable = true;
+    for (int i = 0; i < UINT8_COUNT; i++) p->facts[i] = unknownFact;
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        int at = entries->index[i];
+        if (at >= 0) {
+            if (reachable && !p->rewrite) {
+                changed |= meet(ir, entries, i, p->facts);
+            }
+            if (entries->seen[at]) {
+                memcpy(p->facts, &entries->facts[at * UINT8_COUNT],
+                       sizeof(p->facts));
+                reachable = true;
+            }
+        }
+        if (!reachable) continue;
+        propagateStatement(p, statement, depths[i]);
+        if (isJump(statement) && !p->rewrite) {
+            changed |= meet(ir, entries, statement->target, p->facts);
+        }
+        if (!fallsThrough(statement)) reachable = false;
+    }
+    return changed;
+}
+
+// constant and copy propagation with constant folding
+static int propagate(Ir* ir) {
+    int* depths = ARENA_ALLOCATE(ir->arena, int, ir->count + 1);
+    computeDepths(ir, depths);
+    Entries entries;
+    entries.index = ARENA_ALLOCATE(ir->arena, int, ir->count);
+    entries.count = 0;
+    for (int i = 0; i < ir->count; i++) entries.index[i] = -1;
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        if (isJump(statement) && entries.index[statement->target] < 0) {
+            entries.index[statement->target] = entries.count++;
+        }
+    }
+    entries.facts =
+        ARENA_ALLOCATE(ir->arena, Fact, entries.count * UINT8_COUNT);
+    entries.seen = ARENA_ALLOCATE(ir->arena, bool, entries.count);
+    for (int i = 0; i < entries.count; i++) entries.seen[i] = false;
+
+    Propagation p;
+    p.ir = ir;
+    p.changes = 0;
+    p.rewrite = false;
+    while (sweep(&p, &entries, depths)) {
+    }
+    p.rewrite = true;
+    sweep(&p, &entries, depths);
+    return p.changes;
+}
+
+// resolves branches on literals and removes code nothing reaches
+static int simplifyBranches(Ir* ir) {
+    int changes = 0;
+    bool* alwaysJumps = ARENA_ALLOCATE(ir->arena, bool, ir->count);
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        alwaysJumps[i] = false;
+        if (statement->kind != IR_BRANCH) continue;
+        IrNode* condition = &ir->nodes[statement->expr];
+        if (!isLiteral(condition)) continue;
+        if (isFalseyLiteral(literalValue(ir, condition))) {
+            alwaysJumps[i] = true;
+        } else {
+            // never taken, the condition is still popped after it
+            statement->kind = IR_PUSH;
+            changes++;
+        }
+    }
+
+    bool* reached = ARENA_ALLOCATE(ir->arena, bool, ir->count);
+    int* worklist = ARENA_ALLOCATE(ir->arena, int, ir->count);
+    for (int i = 0; i < ir->count; i++) reached[i] = false;
+    int pending = 0;
+    if (ir->count > 0) {
+        reached[0] = true;
+        worklist[pending++] = 0;
+    }
+    while (pending > 0) {
+        int i = worklist[--pending];
+        IrStatement* statement = &ir->statements[i];
+        int next[2] = {-1, -1};
+        if (fallsThrough(statement) && !alwaysJumps[i] &&
+            i + 1 < ir->count) {
+            next[0] = i + 1;
+        }
+        if (isJump(statement)) next[1] = statement->target;
+        for (int j = 0; j < 2; j++) {
+            if (next[j] < 0 || reached[next[j]]) continue;
+            reached[next[j]] = true;
+            worklist[pending++] = next[j];
+        }
+    }
+    for (int i = 0; i < ir->count; i++) {
+        if (reached[i] || ir->statements[i].kind == IR_NOP) continue;
+        removeStatement(&ir->statements[i]);
+        changes++;
+    }
+
+    // a branch to where it would fall through anyway only pushes
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        if (statement->kind != IR_BRANCH) continue;
+        int next = i + 1;
+        while (next < statement->target &&
+               ir->statements[next].kind == IR_NOP) {
+            next++;
+        }
+        if (next != statement->target) continue;
+        statement->kind = IR_PUSH;
+        changes++;
+    }
+    return changes;
+}
+
+typedef struct {
+    uint64_t bits[UINT8_COUNT / 64];
+} SlotSet;
+
+static bool hasSlot(const SlotSet* set, int slot) {
+    return (set->bits[slot / 64] >> (slot % 64)) & 1;
+}
+
+static void addSlot(SlotSet* set, int slot) {
+    set->bits[slot / 64] |= (uint64_t)1 << (slot % 64);
+}
+
+static void removeSlot(SlotSet* set, int slot) {
+    set->bits[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+}
+
+// walks the tree against the order it is evaluated in, turning stores
+// to slots nobody reads afterwards into their values when rewriting
+static int liveNode(Ir* ir, int index, SlotSet* live, bool rewrite) {
+    IrNode* node = &ir->nodes[index];
+    switch (node->op) {
+        case OP_GET_LOCAL:
+            addSlot(live, node->operand);
+            return 0;
+        case OP_SET_LOCAL:
+            if (rewrite && !hasSlot(live, node->operand)) {
+                *node = ir->nodes[node->left];
+                return 1 + liveNode(ir, index, live, rewrite);
+            }
+            removeSlot(live, node->operand);
+            return liveNode(ir, node->left, live, rewrite);
+        default: {
+            int changes = 0;
+            if (node->right >= 0) {
+                changes += liveNode(ir, node->right, live, rewrite);
+            }
+            if (node->left >= 0) {
+                changes += liveNode(ir, node->left, live, rewrite);
+            }
+            return changes;
+        }
+    }
+}
+
+static int liveStatement(Ir* ir, IrStatement* statement, int depth,
+                         SlotSet* live, bool rewrite) {
+    switch (statement->kind) {
+        case IR_PUSH:
+        case IR_BRANCH:
+            removeSlot(live, depth);
+            break;
+        case IR_DROP:
+            for (int i = 1; i <= statement->operand; i++) {
+                removeSlot(live, depth - i);
+            }
+            break;
+        default:
+            break;
+    }
+    if (statement->expr < 0) return 0;
+    return liveNode(ir, statement->expr, live, rewrite);
+}
+
+static SlotSet liveOut(const Ir* ir, const SlotSet* liveIn, int i) {
+    const IrStatement* statement = &ir->statements[i];
+    SlotSet out;
+    memset(&out, 0, sizeof(out));
+    int next[2] = {-1, -1};
+    if (fallsThrough(statement) && i + 1 < ir->count) next[0] = i + 1;
+    if (isJump(statement)) next[1] = statement->target;
+    for (int j = 0; j < 2; j++) {
+        if (next[j] < 0) continue;
+        for (int k = 0; k < UINT8_COUNT / 64; k++) {
+            out.bits[k] |= liveIn[next[j]].bits[k];
+        }
+    }
+    return out;
+}
+
+// removes stores to locals that are not read before the next store
+static int eliminateDeadStores(Ir* ir) {
+    int* depths = ARENA_ALLOCATE(ir->arena, int, ir->count + 1);
+    computeDepths(ir, depths);
+    SlotSet* liveIn = ARENA_ALLOCATE(ir->arena, SlotSet, ir->count);
+    memset(liveIn, 0, sizeof(SlotSet) * ir->count);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = ir->count - 1; i >= 0; i--) {
+            SlotSet live = liveOut(ir, liveIn, i);
+            liveStatement(ir, &ir->statements[i], depths[i], &live, false);
+            if (memcmp(&live, &liveIn[i], sizeof(live)) != 0) {
+                liveIn[i] = live;
+                changed = true;
+            }
+        }
+    }
+
+    int changes = 0;
+    for (int i = 0; i < ir->count; i++) {
+        SlotSet live = liveOut(ir, liveIn, i);
+        changes +=
+            liveStatement(ir, &ir->statements[i], depths[i], &live, true);
+    }
+    return changes;
+}
+
+static bool readsSlot(const Ir* ir, int index, int slot) {
+    const IrNode* node = &ir->nodes[index];
+    if (node->op == OP_GET_LOCAL && node->operand == slot) return true;
+    return (node->left >= 0 && readsSlot(ir, node->left, slot)) ||
+           (node->right >= 0 && readsSlot(ir, node->right, slot));
+}
+
+// drops the stores to slot and moves the slots above it down by one
+static void removeSlotFrom(Ir* ir, int index, int slot) {
+    IrNode* node = &ir->nodes[index];
+    if (node->op == OP_SET_LOCAL && node->operand == slot) {
+        *node = ir->nodes[node->left];
+        removeSlotFrom(ir, index, slot);
+        return;
+    }
+    if ((node->op == OP_GET_LOCAL || node->op == OP_SET_LOCAL) &&
+        node->operand > slot) {
+        node->operand--;
+    }
+    if (node->left >= 0) removeSlotFrom(ir, node->left, slot);
+    if (node->right >= 0) removeSlotFrom(ir, node->right, slot);
+}
+
+// the statement that pops the value pushed by statement start, -1 if it
+// isn't a plain drop
+static int findDrop(const Ir* ir, const int* depths, int start) {
+    int depth = depths[start];
+    for (int i = start + 1; i < ir->count; i++) {
+        const IrStatement* statement = &ir->statements[i];
+        if (statement->kind == IR_NOP) continue;
+        if (statement->kind != IR_DROP) continue;
+        if (depths[i] - statement->operand > depth) continue;
+        if (depths[i] != depth + 1 || statement->operand != 1) return -1;
+        return i;
+    }
+    return -1;
+}
+
+// gives up the slot of a local nobody reads, typically one that copy
+// propagation has folded into the local it copied. the locals above it
+// move down into the slot.
+static int coalesceSlots(Ir* ir) {
+    int* depths = ARENA_ALLOCATE(ir->arena, int, ir->count + 1);
+    // the first and last statement jumping to each one
+    int* firstSource = ARENA_ALLOCATE(ir->arena, int, ir->count);
+    int* lastSource = ARENA_ALLOCATE(ir->arena, int, ir->count);
+    for (int i = 0; i < ir->count; i++) {
+        firstSource[i] = ir->count;
+        lastSource[i] = -1;
+    }
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        if (!isJump(statement)) continue;
+        if (i < firstSource[statement->target]) {
+            firstSource[statement->target] = i;
+        }
+        if (i > lastSource[statement->target]) {
+            lastSource[statement->target] = i;
+        }
+    }
+
+    int changes = 0;
+    for (int start = 0; start < ir->count; start++) {
+        if (ir->statements[start].kind != IR_PUSH) continue;
+        computeDepths(ir, depths);
+        int slot = depths[start];
+        int end = findDrop(ir, depths, start);
+        if (end < 0) continue;
+
+        // control has to enter and leave the local's life in order
+        bool contained = true;
+        for (int i = start + 1; i <= end && contained; i++) {
+            IrStatement* statement = &ir->statements[i];
+            if (isJump(statement) &&
+                (statement->target <= start || statement->target > end)) {
+                contained = false;
+            }
+            if (firstSource[i] <= start ||
+                (lastSource[i] > end && lastSource[i] >= 0)) {
+                contained = false;
+            }
+            if (statement->expr >= 0 &&
+                readsSlot(ir, statement->expr, slot)) {
+                contained = false;
+            }
+        }
+        if (!contained) continue;
+
+        for (int i = start + 1; i < end; i++) {
+            IrStatement* statement = &ir->statements[i];
+            if (statement->expr >= 0) {
+                removeSlotFrom(ir, statement->expr, slot);
+            }
+        }
+        ir->statements[start].kind = IR_POP;
+        removeStatement(&ir->statements[end]);
+        changes++;
+    }
+    return changes;
+}
+
+// removes statements that compute something only to throw it away
+static int removeDeadCode(Ir* ir) {
+    int changes = 0;
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        if (statement->kind != IR_POP || !isPure(ir, statement->expr)) {
+            continue;
+        }
+        removeStatement(statement);
+        changes++;
+    }
+    return changes;
+}
+
+// numeric type inference. numbers holds the slots known to hold a
+// number however control got to the statement being looked at.
+typedef struct {
+    Ir* ir;
+    SlotSet numbers;
+    bool rewrite;
+} Inference;
+
+// whether the tree always evaluates to a number, visiting it in the
+// order it is evaluated. when rewriting, the checked ops whose operands
+// are known to be numbers become their unchecked forms.
+static bool inferNode(Inference* inference, int index) {
+    Ir* ir = inference->ir;
+    IrNode* node = &ir->nodes[index];
+    switch (node->op) {
+        case OP_CONSTANT:
+            return IS_NUMBER(ir->chunk->constants.values[node->operand]);
+        case OP_GET_LOCAL:
+            return hasSlot(&inference->numbers, node->operand);
+        case OP_SET_LOCAL: {
+            bool number = inferNode(inference, node->left);
+            if (number) {
+                addSlot(&inference->numbers, node->operand);
+            } else {
+                removeSlot(&inference->numbers, node->operand);
+            }
+            return number;
+        }
+        case OP_SET_GLOBAL:
+            return inferNode(inference, node->left);
+        case OP_NEGATE:
+            if (inferNode(inference, node->left) && inference->rewrite) {
+                node->op = OP_NEGATE_NUMBER;
+            }
+            // anything but a number stops the script
+            return true;
+        case OP_ADD: {
+            bool left = inferNode(inference, node->left);
+            bool right = inferNode(inference, node->right);
+            if (!left || !right) return false;
+            if (inference->rewrite) node->op = OP_ADD_NUMBER;
+            return true;
+        }
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+            // unchecked, they make a number of whatever they get
+            inferNode(inference, node->left);
+            inferNode(inference, node->right);
+            return true;
+        default:
+            if (node->left >= 0) inferNode(inference, node->left);
+            if (node->right >= 0) inferNode(inference, node->right);
+            return false;
+    }
+}
+
+static void inferStatement(Inference* inference, IrStatement* statement,
+                           int depth) {
+    bool number =
+        statement->expr >= 0 && inferNode(inference, statement->expr);
+    switch (statement->kind) {
+        case IR_PUSH:
+        case IR_BRANCH:
+            if (number) {
+                addSlot(&inference->numbers, depth);
+            } else {
+                removeSlot(&inference->numbers, depth);
+            }
+            break;
+        case IR_DROP:
+            for (int i = 1; i <= statement->operand; i++) {
+                removeSlot(&inference->numbers, depth - i);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// narrows the slots known to be numbers where control arrives at a
+// jump target to those known on the way in from here too
+static bool meetNumbers(SlotSet* entry, bool* seen, const SlotSet* numbers) {
+    SlotSet met = *numbers;
+    if (*seen) {
+        for (int i = 0; i < UINT8_COUNT / 64; i++) {
+            met.bits[i] &= entry->bits[i];
+        }
+    }
+    bool changed = !*seen || memcmp(&met, entry, sizeof(met)) != 0;
+    *entry = met;
+    *seen = true;
+    return changed;
+}
+
+// one pass over the statements, see sweep()
+static bool inferSweep(Inference* inference, SlotSet* entries, bool* seen,
+                       const bool* targets, const int* depths) {
+    Ir* ir = inference->ir;
+    bool changed = false;
+    bool reachable = true;
+    memset(&inference->numbers, 0, sizeof(inference->numbers));
+    for (int i = 0; i < ir->count; i++) {
+        IrStatement* statement = &ir->statements[i];
+        if (targets[i]) {
+            if (reachable && !inference->rewrite) {
+                changed |= meetNumbers(&entries[i], &seen[i],
+                                       &inference->numbers);
+            }
+            if (seen[i]) {
+                inference->numbers = entries[i];
+                reachable = true;
+            }
+        }
+        if (!reachable) continue;
+        inferStatement(inference, statement, depths[i]);
+        if (isJump(statement) && !inference->rewrite) {
+            changed |= meetNumbers(&entries[statement->target],
+                                   &seen[statement->target],
+                                   &inference->numbers);
+        }
+        if (!fallsThrough(statement)) reachable = false;
+    }
+    return changed;
+}
+
+// proves which locals always hold numbers and drops the type checks of
+// the additions and negations that only ever get numbers
+static void inferNumbers(Ir* ir) {
+    int* depths = ARENA_ALLOCATE(ir->arena, int, ir->count + 1);
+    computeDepths(ir, depths);
+    bool* targets = ARENA_ALLOCATE(ir->arena, bool, ir->count);
+    bool* seen = ARENA_ALLOCATE(ir->arena, bool, ir->count);
+    SlotSet* entries = ARENA_ALLOCATE(ir->arena, SlotSet, ir->count);
+    for (int i = 0; i < ir->count; i++) {
+        targets[i] = false;
+        seen[i] = false;
+    }
+    for (int i = 0; i < ir->count; i++) {
+        if (isJump(&ir->statements[i])) {
+            targets[ir->statements[i].target] = true;
+        }
+    }
+
+    Inference inference;
+    inference.ir = ir;
+    inference.rewrite = false;
+    while (inferSweep(&inference, entries, seen, targets, depths)) {
+    }
+    inference.rewrite = true;
+    inferSweep(&inference, entries, seen, targets, depths);
+}
+
+bool optimizeCode(Chunk* chunk, Arena* arena) {
+    Ir ir;
+    initIr(&ir, chunk, arena);
+    bool optimized = buildIr(&ir);
+    for (int round = 0; optimized && round < MAX_ROUNDS; round++) {
+        int changes = propagate(&ir);
+        changes += simplifyBranches(&ir);
+        changes += eliminateDeadStores(&ir);
+        changes += coalesceSlots(&ir);
+        changes += removeDeadCode(&ir);
+        if (changes == 0) break;
+    }
+    if (optimized) inferNumbers(&ir);
+    if (optimized) optimized = lowerIr(&ir);
+    return optimized;
+}
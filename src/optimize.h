@@ -0,0 +1,25 @@
+#ifndef clox_optimize_h
+#define clox_optimize_h
+
+#include "arena.h"
+#include "chunk.h"
+
+// the optimization levels compile() takes from the vm. at 0 chunks are
+// left as the compiler emits them, at 1 they go through the ir and the
+// passes in optimize.c.
+#define OPT_LEVEL_NONE 0
+#define OPT_LEVEL_IR 1
+
+// lifts chunk into the ir, runs constant and copy propagation, constant
+// folding, dead code and dead store elimination and local slot
+// coalescing until nothing changes, then infers which locals always
+// hold numbers to replace checked arithmetic with OP_ADD_NUMBER and
+// OP_NEGATE_NUMBER, and lowers the result back into chunk. returns
+// false, leaving chunk as it was, if the code can't be lifted. the ir
+// and scratch memory come from arena.
+//
+// a `+` of anything but two numbers or two strings stops the script, so
+// one is only removed when its operands are known.
+bool optimizeCode(Chunk* chunk, Arena* arena);
+
+#endif
@@ -0,0 +1,73 @@
+#include "output.h"
+
+#include <string.h>
+
+#include "number.h"
+#include "object.h"
+
+void initOutput(OutputBuffer* output, FILE* file) {
+    output->file = file;
+    output->length = 0;
+}
+
+void flushOutput(OutputBuffer* output) {
+    if (output->length > 0) {
+        fwrite(output->data, 1, output->length, output->file);
+        output->length = 0;
+    }
+    fflush(output->file);
+}
+
+void writeOutput(OutputBuffer* output, const char* chars, int length) {
+    if (output->length + length > OUTPUT_BUFFER_SIZE) {
+        flushOutput(output);
+        if (length > OUTPUT_BUFFER_SIZE) {
+            // too big to be worth copying
+            fwrite(chars, 1, length, output->file);
+            return;
+        }
+    }
+    memcpy(output->data + output->length, chars, length);
+    output->length += length;
+}
+
+static void writeArray(OutputBuffer* output, const ObjArray* array) {
+    writeOutput(output, "[", 1);
+    for (int i = 0; i < array->count; i++) {
+        if (i > 0) writeOutput(output, ", ", 2);
+        writeValue(output, NUMBER_VAL(array->values[i]));
+    }
+    writeOutput(output, "]", 1);
+}
+
+void writeValue(OutputBuffer* output, Value value) {
+    switch (value.type) {
+        case VAL_NUMBER: {
+            if (output->length + NUMBER_BUFFER_SIZE > OUTPUT_BUFFER_SIZE) {
+                flushOutput(output);
+            }
+            // format straight into the buffer
+            output->length += formatNumber(AS_NUMBER(value),
+                                           output->data + output->length);
+            break;
+        }
+        case VAL_BOOL:
+            if (AS_BOOL(value)) {
+                writeOutput(output, "true", 4);
+            } else {
+                writeOutput(output, "false", 5);
+            }
+            break;
+        case VAL_NIL:
+            writeOutput(output, "nil", 3);
+            break;
+        case VAL_OBJ:
+            if (IS_STRING(value)) {
+                ObjString* string = AS_STRING(value);
+                writeOutput(output, string->chars, string->length);
+            } else if (IS_ARRAY(value)) {
+                writeArray(output, AS_ARRAY(value));
+            }
+            break;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef clox_output_h
+#define clox_output_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "value.h"
+
+#define OUTPUT_BUFFER_SIZE 8192
+
+// what the program prints is collected here and written out in large
+// blocks. it is flushed when full, at the end of a run and before any
+// error is reported.
+typedef struct {
+    FILE* file;
+    int length;
+    char data[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
+
+void initOutput(OutputBuffer* output, FILE* file);
+void flushOutput(OutputBuffer* output);
+void writeOutput(OutputBuffer* output, const char* chars, int length);
+void writeValue(OutputBuffer* output, Value value);
+
+#endif
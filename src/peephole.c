@@ -0,0 +1,187 @@
+#include "peephole.h"
+
+#include "memory.h"
+
+// a jump in the rewritten code and the original offset it goes to
+typedef struct {
+    int at;
+    int target;
+} Jump;
+
+typedef struct {
+    const Chunk* chunk;
+    Arena* arena;
+    bool* targets;
+    uint8_t* code;
+    int* lines;
+    int count;
+    int capacity;
+    // the rewritten offset of each original instruction
+    int* offsets;
+    Jump* jumps;
+    int jumpCount;
+    int jumpCapacity;
+} Rewriter;
+
+static void writeByte(Rewriter* rw, uint8_t byte, int line) {
+    if (rw->capacity < rw->count + 1) {
+        int oldCapacity = rw->capacity;
+        rw->capacity = GROW_CAPACITY(oldCapacity);
+        rw->code = ARENA_GROW_ARRAY(rw->arena, uint8_t, rw->code,
+                                    oldCapacity, rw->capacity);
+        rw->lines = ARENA_GROW_ARRAY(rw->arena, int, rw->lines, oldCapacity,
+                                     rw->capacity);
+    }
+    rw->code[rw->count] = byte;
+    rw->lines[rw->count] = line;
+    rw->count++;
+}
+
+static int jumpTarget(const Chunk* chunk, int offset) {
+    int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    return chunk->code[offset] == OP_LOOP ? offset + 3 - jump
+                                          : offset + 3 + jump;
+}
+
+// writes a jump with its distance left to patchJumps()
+static void writeJump(Rewriter* rw, uint8_t instruction, int target,
+                      int line) {
+    if (rw->jumpCapacity < rw->jumpCount + 1) {
+        int oldCapacity = rw->jumpCapacity;
+        rw->jumpCapacity = GROW_CAPACITY(oldCapacity);
+        rw->jumps = ARENA_GROW_ARRAY(rw->arena, Jump, rw->jumps,
+                                     oldCapacity, rw->jumpCapacity);
+    }
+    rw->jumps[rw->jumpCount++] = (Jump){rw->count, target};
+    writeByte(rw, instruction, line);
+    writeByte(rw, 0xff, line);
+    writeByte(rw, 0xff, line);
+}
+
+// the instruction at offset if it can be fused into the one before it
+static int fusable(Rewriter* rw, int offset) {
+    if (offset >= rw->chunk->count || rw->targets[offset]) return -1;
+    return rw->chunk->code[offset];
+}
+
+// rewrites the instruction at offset, fused with the ones after it where
+// a pattern matches, and returns the offset of the next one left
+static int rewriteInstruction(Rewriter* rw, int offset) {
+    const Chunk* chunk = rw->chunk;
+    uint8_t instruction = chunk->code[offset];
+    int next = offset + 1 + operandLength(instruction);
+    uint8_t operand = next > offset + 1 ? chunk->code[offset + 1] : 0;
+    int following = fusable(rw, next);
+    int line = chunk->lines[offset];
+
+    switch (instruction) {
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+            if (following != OP_NOT) break;
+            writeByte(rw,
+                      instruction == OP_EQUAL     ? OP_NOT_EQUAL
+                      : instruction == OP_GREATER ? OP_LESS_EQUAL
+                                                  : OP_GREATER_EQUAL,
+                      line);
+            return next + 1;
+        case OP_SET_LOCAL:
+        case OP_SET_GLOBAL:
+            if (following != OP_POP) break;
+            writeByte(rw,
+                      instruction == OP_SET_LOCAL ? OP_SET_LOCAL_POP
+                                                  : OP_SET_GLOBAL_POP,
+                      line);
+            writeByte(rw, operand, line);
+            return next + 1;
+        case OP_CONSTANT:
+            if (following != OP_ADD && following != OP_ADD_NUMBER &&
+                following != OP_LESS) {
+                break;
+            }
+            writeByte(rw,
+                      following == OP_ADD          ? OP_ADD_CONSTANT
+                      : following == OP_ADD_NUMBER ? OP_ADD_NUMBER_CONSTANT
+                                                   : OP_LESS_CONSTANT,
+                      line);
+            writeByte(rw, operand, line);
+            return next + 1;
+        case OP_POP: {
+            int count = 1;
+            while (count < UINT8_MAX && following == OP_POP) {
+                count++;
+                next++;
+                following = fusable(rw, next);
+            }
+            if (count == 1) break;
+            writeByte(rw, OP_POPN, line);
+            writeByte(rw, count, line);
+            return next;
+        }
+        case OP_JUMP_IF_FALSE:
+            writeJump(rw,
+                      following == OP_POP ? OP_JUMP_IF_FALSE_POP
+                                          : OP_JUMP_IF_FALSE,
+                      jumpTarget(chunk, offset), line);
+            return following == OP_POP ? next + 1 : next;
+        case OP_LOOP:
+            writeJump(rw, OP_LOOP, jumpTarget(chunk, offset), line);
+            return next;
+    }
+
+    for (int i = offset; i < next; i++) writeByte(rw, chunk->code[i], line);
+    return next;
+}
+
+// fills in the jump distances, which only shrink when code is fused
+static void patchJumps(Rewriter* rw) {
+    for (int i = 0; i < rw->jumpCount; i++) {
+        Jump* jump = &rw->jumps[i];
+        int after = jump->at + 3;
+        int target = rw->offsets[jump->target];
+        int distance = rw->code[jump->at] == OP_LOOP ? after - target
+                                                     : target - after;
+        rw->code[jump->at + 1] = (distance >> 8) & 0xff;
+        rw->code[jump->at + 2] = distance & 0xff;
+    }
+}
+
+// marks the jump targets, false if the chunk holds anything unknown
+static bool findTargets(const Chunk* chunk, bool* targets) {
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t instruction = chunk->code[offset];
+        int length = operandLength(instruction);
+        if (length < 0 || isSuperinstruction(instruction)) return false;
+        if (instruction == OP_JUMP_IF_FALSE || instruction == OP_LOOP) {
+            int target = jumpTarget(chunk, offset);
+            if (target < 0 || target > chunk->count) return false;
+            targets[target] = true;
+        }
+        offset += 1 + length;
+    }
+    return true;
+}
+
+void optimizeChunk(Chunk* chunk, Arena* arena) {
+    if (chunk->registerCode) return;
+    int count = chunk->count;
+    Rewriter rw = {0};
+    rw.chunk = chunk;
+    rw.arena = arena;
+    rw.targets = ARENA_ALLOCATE(arena, bool, count + 1);
+    rw.offsets = ARENA_ALLOCATE(arena, int, count + 1);
+    for (int i = 0; i <= count; i++) {
+        rw.targets[i] = false;
+        rw.offsets[i] = -1;
+    }
+
+    if (findTargets(chunk, rw.targets)) {
+        for (int offset = 0; offset < count;) {
+            rw.offsets[offset] = rw.count;
+            offset = rewriteInstruction(&rw, offset);
+        }
+        rw.offsets[count] = rw.count;
+        patchJumps(&rw);
+        replaceCode(chunk, rw.code, rw.lines, rw.count);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef clox_peephole_h
+#define clox_peephole_h
+
+#include "arena.h"
+#include "chunk.h"
+
+// fuses common instruction pairs of stack code into the superinstructions
+// at the end of OpCode, relocating jumps and keeping the line table in
+// step. the pairs are the most frequent ones PROFILE_OPCODES reports on
+// bench/corpus. an instruction that is a jump target is never fused into
+// the one before it. register code is left alone. scratch memory comes
+// from arena.
+void optimizeChunk(Chunk* chunk, Arena* arena);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef clox_probes_h
+#define clox_probes_h
+
+// USDT probes for bpftrace, perf and SystemTap, under the provider name
+// "clox". with <sys/sdt.h> each probe is a single nop plus an ELF note
+// until a tracer attaches; without it, or with DISABLE_PROBES, they
+// compile to nothing. tools/list_probes.sh lists the probes in a binary.
+//
+//   compile__begin(source)            compile__end(ok)
+//   interpret__begin(source)          interpret__end(result, instructions)
+//     (source is NULL when a vm runs a compiled program)
+//   object__alloc(type, size)
+//   string__intern__hit(chars, len)   string__intern__miss(chars, len)
+//   map__resize(map, oldCapacity, newCapacity)
+//   runtime__error(message, line)
+
+#if !defined(DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_PROBES
+#endif
+#endif
+
+#ifdef HAVE_PROBES
+#include <sys/sdt.h>
+#define PROBE1(name, a) DTRACE_PROBE1(clox, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(clox, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(clox, name, a, b, c)
+#else
+#define PROBE1(name, a) \
+    do {                \
+    } while (false)
+#define PROBE2(name, a, b) \
+    do {                   \
+    } while (false)
+#define PROBE3(name, a, b, c) \
+    do {                      \
+    } while (false)
+#endif
+
+#endif
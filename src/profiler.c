@@ -0,0 +1,258 @@
+#include "profiler.h"
+
+#ifdef PROFILE_OPCODES
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "memory.h"
+
+#define REPORT_LIMIT 20
+
+// every run of every vm, reported by reportProfile()
+static Profile total;
+static pthread_mutex_t totalLock = PTHREAD_MUTEX_INITIALIZER;
+
+void initProfile(Profile* profile) {
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        profile->counts[i] = 0;
+        profile->cycles[i] = 0;
+    }
+    profile->pairCounts = NULL;
+    profile->previous = -1;
+    profile->chunk = NULL;
+    profile->offsetCounts = NULL;
+    profile->offsetCycles = NULL;
+    profile->spotCount = 0;
+    profile->spotCapacity = 0;
+    profile->spots = NULL;
+    profile->nextSample = PROFILE_SAMPLE_PERIOD;
+    profile->period = PROFILE_SAMPLE_PERIOD;
+    profile->seed = 1;
+    profile->timing = false;
+}
+
+void freeProfile(Profile* profile) {
+    FREE_ARRAY(HotSpot, profile->spots, profile->spotCapacity);
+    free(profile->pairCounts);
+    initProfile(profile);
+}
+
+void profileBeginChunk(Profile* profile, Chunk* chunk) {
+    profile->chunk = chunk;
+    profile->offsetCounts = calloc(chunk->count, sizeof(uint64_t));
+    profile->offsetCycles = calloc(chunk->count, sizeof(uint64_t));
+    if (profile->pairCounts == NULL) {
+        profile->pairCounts =
+            calloc(UINT8_COUNT * UINT8_COUNT, sizeof(uint64_t));
+    }
+    profile->previous = -1;
+    profile->timing = false;
+}
+
+static void addSpot(Profile* profile, HotSpot spot) {
+    if (profile->spotCapacity < profile->spotCount + 1) {
+        int oldCapacity = profile->spotCapacity;
+        profile->spotCapacity = GROW_CAPACITY(oldCapacity);
+        profile->spots = GROW_ARRAY(HotSpot, profile->spots, oldCapacity,
+                                    profile->spotCapacity);
+    }
+    profile->spots[profile->spotCount++] = spot;
+}
+
+void profileEndChunk(Profile* profile) {
+    Chunk* chunk = profile->chunk;
+    pthread_mutex_lock(&totalLock);
+    for (int offset = 0; offset < chunk->count; offset++) {
+        if (profile->offsetCounts[offset] == 0) continue;
+        total.cycles[chunk->code[offset]] += profile->offsetCycles[offset];
+        HotSpot spot = {chunk->lines[offset], offset, chunk->code[offset],
+                        profile->offsetCounts[offset],
+                        profile->offsetCycles[offset]};
+        addSpot(&total, spot);
+    }
+    if (total.pairCounts == NULL) {
+        total.pairCounts = calloc(UINT8_COUNT * UINT8_COUNT, sizeof(uint64_t));
+    }
+    for (int i = 0; i < UINT8_COUNT * UINT8_COUNT; i++) {
+        total.pairCounts[i] += profile->pairCounts[i];
+    }
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        total.counts[i] += profile->counts[i];
+    }
+    pthread_mutex_unlock(&totalLock);
+    memset(profile->pairCounts, 0,
+           sizeof(uint64_t) * UINT8_COUNT * UINT8_COUNT);
+    memset(profile->counts, 0, sizeof(profile->counts));
+
+    free(profile->offsetCounts);
+    free(profile->offsetCycles);
+    profile->offsetCounts = NULL;
+    profile->offsetCycles = NULL;
+    profile->chunk = NULL;
+    profile->timing = false;
+}
+
+static int compareSpots(const void* a, const void* b) {
+    uint64_t x = ((const HotSpot*)a)->cycles;
+    uint64_t y = ((const HotSpot*)b)->cycles;
+    return (x < y) - (x > y);
+}
+
+// hot spots of the same line added together, sorted by cycles
+static int collectLines(Profile* profile, HotSpot* lines) {
+    int count = 0;
+    for (int i = 0; i < profile->spotCount; i++) {
+        HotSpot* spot = &profile->spots[i];
+        int j = 0;
+        while (j < count && lines[j].line != spot->line) j++;
+        if (j == count) {
+            lines[count] = *spot;
+            lines[count].count = 0;
+            lines[count].cycles = 0;
+            count++;
+        }
+        lines[j].count += spot->count;
+        lines[j].cycles += spot->cycles;
+    }
+    qsort(lines, count, sizeof(HotSpot), compareSpots);
+    return count;
+}
+
+static int comparePairs(const void* a, const void* b) {
+    uint64_t x = ((const OpcodePair*)a)->count;
+    uint64_t y = ((const OpcodePair*)b)->count;
+    return (x < y) - (x > y);
+}
+
+// the pairs that ran at all, most frequent first
+static int collectPairs(Profile* profile, OpcodePair* pairs) {
+    int count = 0;
+    if (profile->pairCounts == NULL) return 0;
+    for (int i = 0; i < UINT8_COUNT * UINT8_COUNT; i++) {
+        if (profile->pairCounts[i] == 0) continue;
+        OpcodePair pair = {(uint8_t)(i / UINT8_COUNT),
+                           (uint8_t)(i % UINT8_COUNT),
+                           profile->pairCounts[i]};
+        pairs[count++] = pair;
+    }
+    qsort(pairs, count, sizeof(OpcodePair), comparePairs);
+    return count;
+}
+
+static void writeDump(Profile* profile, HotSpot* opcodes, int opcodeCount,
+                      HotSpot* lines, int lineCount, OpcodePair* pairs,
+                      int pairCount) {
+    FILE* file = fopen(PROFILE_DUMP_PATH, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not write \"%s\".\n", PROFILE_DUMP_PATH);
+        return;
+    }
+    fprintf(file, "{\n  \"opcodes\": [");
+    for (int i = 0; i < opcodeCount; i++) {
+        fprintf(file, "%s\n    {\"opcode\": \"%s\", \"count\": %llu, "
+                      "\"cycles\": %llu}",
+                i == 0 ? "" : ",", opcodeName(opcodes[i].opcode),
+                (unsigned long long)opcodes[i].count,
+                (unsigned long long)opcodes[i].cycles);
+    }
+    fprintf(file, "\n  ],\n  \"pairs\": [");
+    for (int i = 0; i < pairCount; i++) {
+        fprintf(file, "%s\n    {\"first\": \"%s\", \"second\": \"%s\", "
+                      "\"count\": %llu}",
+                i == 0 ? "" : ",", opcodeName(pairs[i].first),
+                opcodeName(pairs[i].second),
+                (unsigned long long)pairs[i].count);
+    }
+    fprintf(file, "\n  ],\n  \"lines\": [");
+    for (int i = 0; i < lineCount; i++) {
+        fprintf(file, "%s\n    {\"line\": %d, \"count\": %llu, "
+                      "\"cycles\": %llu}",
+                i == 0 ? "" : ",", lines[i].line,
+                (unsigned long long)lines[i].count,
+                (unsigned long long)lines[i].cycles);
+    }
+    fprintf(file, "\n  ],\n  \"offsets\": [");
+    for (int i = 0; i < profile->spotCount; i++) {
+        HotSpot* spot = &profile->spots[i];
+        fprintf(file, "%s\n    {\"offset\": %d, \"line\": %d, "
+                      "\"opcode\": \"%s\", \"count\": %llu, \"cycles\": %llu}",
+                i == 0 ? "" : ",", spot->offset, spot->line,
+                opcodeName(spot->opcode), (unsigned long long)spot->count,
+                (unsigned long long)spot->cycles);
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+}
+
+void reportProfile() {
+    Profile* profile = &total;
+    uint64_t totalCount = 0;
+    uint64_t totalCycles = 0;
+    HotSpot opcodes[UINT8_COUNT];
+    int opcodeCount = 0;
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        if (profile->counts[i] == 0) continue;
+        HotSpot op = {0, 0, (uint8_t)i, profile->counts[i],
+                      profile->cycles[i]};
+        opcodes[opcodeCount++] = op;
+        totalCount += profile->counts[i];
+        totalCycles += profile->cycles[i];
+    }
+    if (totalCount == 0) {
+        freeProfile(profile);
+        return;
+    }
+    if (totalCycles == 0) totalCycles = 1;
+    qsort(opcodes, opcodeCount, sizeof(HotSpot), compareSpots);
+    qsort(profile->spots, profile->spotCount, sizeof(HotSpot), compareSpots);
+    HotSpot* lines = malloc(sizeof(HotSpot) * (profile->spotCount + 1));
+    int lineCount = collectLines(profile, lines);
+    OpcodePair* pairs = malloc(sizeof(OpcodePair) * UINT8_COUNT * UINT8_COUNT);
+    int pairCount = collectPairs(profile, pairs);
+
+    fprintf(stderr, "== opcode profile (%llu instructions) ==\n",
+            (unsigned long long)totalCount);
+    fprintf(stderr, "%-18s %14s %14s %7s\n", "opcode", "count", "cycles",
+            "%");
+    for (int i = 0; i < opcodeCount; i++) {
+        fprintf(stderr, "%-18s %14llu %14llu %6.2f%%\n",
+                opcodeName(opcodes[i].opcode),
+                (unsigned long long)opcodes[i].count,
+                (unsigned long long)opcodes[i].cycles,
+                100.0 * opcodes[i].cycles / totalCycles);
+    }
+    fprintf(stderr, "== hot pairs ==\n");
+    for (int i = 0; i < pairCount && i < REPORT_LIMIT; i++) {
+        fprintf(stderr, "%-20s %-20s %14llu %6.2f%%\n",
+                opcodeName(pairs[i].first), opcodeName(pairs[i].second),
+                (unsigned long long)pairs[i].count,
+                100.0 * pairs[i].count / totalCount);
+    }
+    fprintf(stderr, "== hot lines ==\n");
+    for (int i = 0; i < lineCount && i < REPORT_LIMIT; i++) {
+        fprintf(stderr, "line %-6d %14llu %14llu %6.2f%%\n", lines[i].line,
+                (unsigned long long)lines[i].count,
+                (unsigned long long)lines[i].cycles,
+                100.0 * lines[i].cycles / totalCycles);
+    }
+    fprintf(stderr, "== hot offsets ==\n");
+    for (int i = 0; i < profile->spotCount && i < REPORT_LIMIT; i++) {
+        HotSpot* spot = &profile->spots[i];
+        fprintf(stderr, "%04d line %-6d %-18s %14llu %14llu\n", spot->offset,
+                spot->line, opcodeName(spot->opcode),
+                (unsigned long long)spot->count,
+                (unsigned long long)spot->cycles);
+    }
+
+    writeDump(profile, opcodes, opcodeCount, lines, lineCount, pairs,
+              pairCount);
+    free(pairs);
+    free(lines);
+    freeProfile(profile);
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef clox_profiler_h
+#define clox_profiler_h
+
+#include "chunk.h"
+#include "common.h"
+
+#ifdef PROFILE_OPCODES
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define READ_CYCLES() __rdtsc()
+#else
+#include <time.h>
+static inline uint64_t readNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#define READ_CYCLES() readNanoseconds()
+#endif
+
+// every opcode execution is counted, but only about one instruction in
+// PROFILE_SAMPLE_PERIOD is timed and attributed to its offset. reading
+// the cycle counter on each dispatch would cost more than most
+// instructions do. the period is jittered so that it can't stay in phase
+// with a loop body.
+#define PROFILE_SAMPLE_PERIOD 1024
+#define PROFILE_DUMP_PATH "clox-profile.json"
+
+typedef struct {
+    int line;
+    int offset;
+    uint8_t opcode;
+    uint64_t count;
+    uint64_t cycles;
+} HotSpot;
+
+// an opcode and the one run right after it
+typedef struct {
+    uint8_t first;
+    uint8_t second;
+    uint64_t count;
+} OpcodePair;
+
+typedef struct {
+    uint64_t counts[UINT8_COUNT];
+    uint64_t cycles[UINT8_COUNT];
+    // UINT8_COUNT * UINT8_COUNT counters indexed by first and second
+    // opcode, the data superinstructions are picked from
+    uint64_t* pairCounts;
+    int previous;
+
+    // per offset estimates for the chunk that is running
+    Chunk* chunk;
+    uint64_t* offsetCounts;
+    uint64_t* offsetCycles;
+
+    // offsets of finished chunks, only kept by the process-wide profile
+    int spotCount;
+    int spotCapacity;
+    HotSpot* spots;
+
+    uint64_t nextSample;
+    int period;
+    uint32_t seed;
+    bool timing;
+    int timedOffset;
+    uint64_t timedStart;
+} Profile;
+
+void initProfile(Profile* profile);
+void freeProfile(Profile* profile);
+void profileBeginChunk(Profile* profile, Chunk* chunk);
+// moves what the chunk's run counted into the profile of the whole
+// process, which every vm on every thread adds to
+void profileEndChunk(Profile* profile);
+// prints the sorted report of the whole process and writes
+// PROFILE_DUMP_PATH. main() calls it once, at exit.
+void reportProfile();
+
+// kept inline, a call in the dispatch loop makes the compiler spill the
+// vm registers on every instruction
+static inline void profileSample(Profile* profile, int offset,
+                                 uint64_t instructions) {
+    if (!profile->timing) {
+        // time just the next instruction
+        profile->timing = true;
+        profile->timedOffset = offset;
+        profile->nextSample = instructions + 1;
+        profile->timedStart = READ_CYCLES();
+        return;
+    }
+    uint64_t cycles = READ_CYCLES() - profile->timedStart;
+    profile->offsetCounts[profile->timedOffset] += profile->period;
+    profile->offsetCycles[profile->timedOffset] += cycles * profile->period;
+    profile->timing = false;
+
+    profile->seed = profile->seed * 1103515245u + 12345u;
+    profile->period = PROFILE_SAMPLE_PERIOD / 2 +
+                      (profile->seed >> 16) % PROFILE_SAMPLE_PERIOD;
+    profile->nextSample = instructions + profile->period - 1;
+}
+
+// instructions is the running instruction count of the vm, comparing
+// against it is cheaper than keeping a countdown of our own
+static inline void profileInstruction(Profile* profile, uint8_t opcode,
+                                      const uint8_t* ip,
+                                      uint64_t instructions) {
+    profile->counts[opcode]++;
+    if (profile->previous >= 0) {
+        profile->pairCounts[profile->previous * UINT8_COUNT + opcode]++;
+    }
+    profile->previous = opcode;
+    if (instructions >= profile->nextSample) {
+        profileSample(profile, (int)(ip - profile->chunk->code),
+                      instructions);
+    }
+}
+
+#endif
+#endif
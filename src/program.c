@@ -0,0 +1,40 @@
+#include "program.h"
+
+#include "compiler.h"
+#include "memory.h"
+#include "vm.h"
+
+// what this thread's compiles reuse, made by the first of them
+static _Thread_local CompileContext* programContext = NULL;
+
+bool compileProgram(Program* program, const char* source, FILE* errorFile) {
+    if (programContext == NULL) {
+        programContext = ALLOCATE(CompileContext, 1);
+        initCompileContext(programContext);
+    }
+    // a scratch vm that puts every string it makes in the shared table.
+    // it only lends the context, so it has nothing of its own to free.
+    VM builder;
+    initVM(&builder);
+    builder.errorFile = errorFile;
+    builder.internShared = true;
+    builder.compileContext = programContext;
+    initChunk(&program->chunk);
+    bool compiled = compile(&builder, source, &program->chunk);
+    builder.compileContext = NULL;
+    freeVM(&builder);
+
+    if (!compiled) freeProgram(program);
+    return compiled;
+}
+
+void freeProgram(Program* program) {
+    freeChunk(&program->chunk);
+}
+
+void freeProgramContext() {
+    if (programContext == NULL) return;
+    freeCompileContext(programContext);
+    FREE(CompileContext, programContext);
+    programContext = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef clox_program_h
+#define clox_program_h
+
+#include <stdio.h>
+
+#include "chunk.h"
+
+// a compiled script frozen for sharing. nothing in it is written after
+// compileProgram() returns, so any number of vms on any threads can run
+// it at the same time. its strings live in the shared table (intern.h),
+// which keeps them unique across every vm that runs it.
+typedef struct Program {
+    Chunk chunk;
+} Program;
+
+// compile errors are reported to errorFile. the arena and buffers the
+// compiler works in are kept per thread and reused by the next compile.
+bool compileProgram(Program* program, const char* source, FILE* errorFile);
+void freeProgram(Program* program);
+// frees what the calling thread's compiles kept
+void freeProgramContext();
+
+#endif
@@ -0,0 +1,354 @@
+#include "registers.h"
+
+#include <string.h>
+
+#include "memory.h"
+
+// the facts about the stack code the translation needs up front
+typedef struct {
+    // jumps land here
+    bool* targets;
+    // the stack depth forward jumps arrive with, -1 if none does
+    int* targetDepths;
+    // the register each constant is loaded into, -1 if it isn't pushed
+    int* constantRegisters;
+    int maxDepth;
+    int registerCount;
+} Analysis;
+
+typedef struct {
+    const Chunk* chunk;
+    Arena* arena;
+    Analysis* analysis;
+    uint8_t* code;
+    int* lines;
+    int count;
+    int capacity;
+    // the register code offset of each stack code offset
+    int* offsets;
+    // the register that holds each stack entry. an entry that lives in
+    // its own slot is materialized, others are loads not yet done.
+    int entries[UINT8_COUNT + 1];
+    int depth;
+    // the last instruction if its result went to the top slot and may
+    // still be sent to a local instead, -1 if there is none
+    int lastWriter;
+    int line;
+} Translator;
+
+static int stackEffect(uint8_t instruction) {
+    switch (instruction) {
+        case OP_CONSTANT:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_GET_GLOBAL:
+            return 1;
+        case OP_EQUAL:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_ADD:
+        case OP_ADD_NUMBER:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_PRINT:
+        case OP_POP:
+        case OP_DEFINE_GLOBAL:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+static int jumpTarget(const Chunk* chunk, int offset) {
+    int jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+    return chunk->code[offset] == OP_LOOP ? offset + 3 - jump
+                                          : offset + 3 + jump;
+}
+
+static bool analyze(const Chunk* chunk, Analysis* analysis) {
+    int depth = 0;
+    for (int offset = 0; offset < chunk->count;) {
+        // code after a backward jump is only reached by jumping to it
+        if (analysis->targetDepths[offset] >= 0) {
+            depth = analysis->targetDepths[offset];
+        }
+        uint8_t instruction = chunk->code[offset];
+        int length = operandLength(instruction);
+        // superinstructions and arrays have no register form
+        if (length < 0 || isSuperinstruction(instruction) ||
+            instruction == OP_GET_INDEX || instruction == OP_SET_INDEX ||
+            instruction == OP_NATIVE) {
+            return false;
+        }
+        if (instruction == OP_CONSTANT) {
+            analysis->constantRegisters[chunk->code[offset + 1]] = 0;
+        } else if (instruction == OP_JUMP_IF_FALSE ||
+                   instruction == OP_LOOP) {
+            int target = jumpTarget(chunk, offset);
+            if (target < 0 || target > chunk->count) return false;
+            analysis->targets[target] = true;
+            if (instruction == OP_JUMP_IF_FALSE) {
+                analysis->targetDepths[target] = depth;
+            }
+        }
+        depth += stackEffect(instruction);
+        if (depth < 0 || depth > UINT8_COUNT) return false;
+        if (depth > analysis->maxDepth) analysis->maxDepth = depth;
+        offset += 1 + length;
+    }
+
+    // constants go above every slot the code uses
+    int next = analysis->maxDepth;
+    for (int i = 0; i < chunk->constants.count; i++) {
+        if (analysis->constantRegisters[i] < 0) continue;
+        analysis->constantRegisters[i] = next++;
+    }
+    analysis->registerCount = next;
+    return next <= UINT8_COUNT;
+}
+
+static int emit(Translator* tr, uint8_t op, int a, int b, int c) {
+    if (tr->capacity < tr->count + REGISTER_INSTRUCTION_SIZE) {
+        int oldCapacity = tr->capacity;
+        tr->capacity = GROW_CAPACITY(oldCapacity);
+        tr->code = ARENA_GROW_ARRAY(tr->arena, uint8_t, tr->code,
+                                    oldCapacity, tr->capacity);
+        tr->lines = ARENA_GROW_ARRAY(tr->arena, int, tr->lines, oldCapacity,
+                                     tr->capacity);
+    }
+    int at = tr->count;
+    tr->lastWriter = -1;
+    uint8_t bytes[REGISTER_INSTRUCTION_SIZE] = {op, a, b, c};
+    for (int i = 0; i < REGISTER_INSTRUCTION_SIZE; i++) {
+        tr->code[tr->count] = bytes[i];
+        tr->lines[tr->count] = tr->line;
+        tr->count++;
+    }
+    return at;
+}
+
+static void materialize(Translator* tr, int entry) {
+    if (tr->entries[entry] == entry) return;
+    emit(tr, REG_MOVE, entry, tr->entries[entry], 0);
+    tr->entries[entry] = entry;
+}
+
+static void materializeAll(Translator* tr) {
+    for (int i = 0; i < tr->depth; i++) materialize(tr, i);
+    tr->lastWriter = -1;
+}
+
+// the result of an instruction goes to the slot of the entry it becomes
+static void emitResult(Translator* tr, uint8_t op, int a, int b, int c) {
+    tr->lastWriter = emit(tr, op, a, b, c);
+    tr->entries[a] = a;
+}
+
+static void setLocal(Translator* tr, int slot) {
+    int top = tr->depth - 1;
+    // loads of the old value have to happen before the store
+    bool loadsMoved = false;
+    for (int i = 0; i < top; i++) {
+        if (i != slot && tr->entries[i] == slot) {
+            materialize(tr, i);
+            loadsMoved = true;
+        }
+    }
+    if (!loadsMoved && tr->lastWriter >= 0 && tr->entries[top] == top &&
+        tr->code[tr->lastWriter + 1] == top) {
+        // the value was just computed, compute it into the local instead
+        tr->code[tr->lastWriter + 1] = slot;
+        tr->entries[top] = slot;
+    } else if (tr->entries[top] != slot) {
+        emit(tr, REG_MOVE, slot, tr->entries[top], 0);
+    }
+    tr->entries[slot] = slot;
+    tr->lastWriter = -1;
+}
+
+static void translateBinary(Translator* tr, uint8_t op) {
+    int a = tr->depth - 2;
+    emitResult(tr, op, a, tr->entries[a], tr->entries[a + 1]);
+    tr->depth--;
+}
+
+static void translateInstruction(Translator* tr, int offset) {
+    const Chunk* chunk = tr->chunk;
+    uint8_t instruction = chunk->code[offset];
+    int next = offset + 1 + operandLength(instruction);
+    uint8_t operand = next > offset + 1 ? chunk->code[offset + 1] : 0;
+    int top = tr->depth - 1;
+
+    switch (instruction) {
+        case OP_CONSTANT:
+            tr->entries[tr->depth++] =
+                tr->analysis->constantRegisters[operand];
+            break;
+        case OP_NIL:
+            emitResult(tr, REG_NIL, tr->depth++, 0, 0);
+            break;
+        case OP_TRUE:
+            emitResult(tr, REG_TRUE, tr->depth++, 0, 0);
+            break;
+        case OP_FALSE:
+            emitResult(tr, REG_FALSE, tr->depth++, 0, 0);
+            break;
+        case OP_GET_LOCAL:
+            materialize(tr, operand);
+            tr->entries[tr->depth++] = operand;
+            break;
+        case OP_SET_LOCAL:
+            setLocal(tr, operand);
+            break;
+        case OP_GET_GLOBAL:
+            emitResult(tr, REG_GET_GLOBAL, tr->depth++, operand, 0);
+            break;
+        case OP_SET_GLOBAL:
+            emit(tr, REG_SET_GLOBAL, tr->entries[top], operand, 0);
+            break;
+        case OP_DEFINE_GLOBAL:
+            emit(tr, REG_DEFINE_GLOBAL, tr->entries[top], operand, 0);
+            tr->depth--;
+            break;
+        case OP_PRINT:
+            emit(tr, REG_PRINT, tr->entries[top], 0, 0);
+            tr->depth--;
+            break;
+        case OP_POP:
+            tr->depth--;
+            break;
+        case OP_EQUAL:
+            translateBinary(tr, REG_EQUAL);
+            break;
+        case OP_LESS:
+            translateBinary(tr, REG_LESS);
+            break;
+        case OP_GREATER:
+            translateBinary(tr, REG_GREATER);
+            break;
+        case OP_ADD:
+            translateBinary(tr, REG_ADD);
+            break;
+        case OP_ADD_NUMBER:
+            translateBinary(tr, REG_ADD_NUMBER);
+            break;
+        case OP_SUBTRACT:
+            translateBinary(tr, REG_SUBTRACT);
+            break;
+        case OP_MULTIPLY:
+            translateBinary(tr, REG_MULTIPLY);
+            break;
+        case OP_DIVIDE:
+            translateBinary(tr, REG_DIVIDE);
+            break;
+        case OP_NEGATE:
+            emitResult(tr, REG_NEGATE, top, tr->entries[top], 0);
+            break;
+        case OP_NEGATE_NUMBER:
+            emitResult(tr, REG_NEGATE_NUMBER, top, tr->entries[top], 0);
+            break;
+        case OP_NOT:
+            emitResult(tr, REG_NOT, top, tr->entries[top], 0);
+            break;
+        case OP_JUMP_IF_FALSE:
+            // both ways on, every entry has to be where the other expects
+            materializeAll(tr);
+            emit(tr, REG_JUMP_IF_FALSE, top, 0, 0);
+            break;
+        case OP_LOOP:
+            materializeAll(tr);
+            emit(tr, REG_LOOP, 0, 0, 0);
+            break;
+        case OP_RETURN:
+            emit(tr, REG_RETURN, 0, 0, 0);
+            break;
+    }
+}
+
+// fills in the jump distances now that every offset is known
+static bool patchJumps(Translator* tr) {
+    const Chunk* chunk = tr->chunk;
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t instruction = chunk->code[offset];
+        int next = offset + 1 + operandLength(instruction);
+        if (instruction == OP_JUMP_IF_FALSE || instruction == OP_LOOP) {
+            // the jump is the last instruction emitted for it
+            int after = tr->offsets[next];
+            int at = after - REGISTER_INSTRUCTION_SIZE;
+            int target = tr->offsets[jumpTarget(chunk, offset)];
+            int distance = instruction == OP_LOOP ? after - target
+                                                  : target - after;
+            if (distance < 0 || distance > UINT16_MAX) return false;
+            tr->code[at + 2] = (distance >> 8) & 0xff;
+            tr->code[at + 3] = distance & 0xff;
+        }
+        offset = next;
+    }
+    return true;
+}
+
+static bool translate(Translator* tr) {
+    const Chunk* chunk = tr->chunk;
+    Analysis* analysis = tr->analysis;
+    tr->line = chunk->count > 0 ? chunk->lines[0] : 0;
+    for (int i = 0; i < chunk->constants.count; i++) {
+        int reg = analysis->constantRegisters[i];
+        if (reg >= 0) emit(tr, REG_LOAD_CONSTANT, reg, i, 0);
+    }
+
+    bool reachable = true;
+    for (int offset = 0; offset < chunk->count;) {
+        uint8_t instruction = chunk->code[offset];
+        tr->line = chunk->lines[offset];
+        if (analysis->targets[offset]) {
+            if (analysis->targetDepths[offset] >= 0) {
+                tr->depth = analysis->targetDepths[offset];
+            }
+            if (reachable) {
+                materializeAll(tr);
+            } else {
+                for (int i = 0; i < tr->depth; i++) tr->entries[i] = i;
+                tr->lastWriter = -1;
+            }
+        }
+        reachable = instruction != OP_LOOP && instruction != OP_RETURN;
+        tr->offsets[offset] = tr->count;
+        translateInstruction(tr, offset);
+        offset += 1 + operandLength(instruction);
+        tr->offsets[offset] = tr->count;
+    }
+    return patchJumps(tr);
+}
+
+bool translateToRegisters(Chunk* chunk, Arena* arena) {
+    int count = chunk->count;
+    int constants = chunk->constants.count;
+    Analysis analysis;
+    analysis.targets = ARENA_ALLOCATE(arena, bool, count + 1);
+    analysis.targetDepths = ARENA_ALLOCATE(arena, int, count + 1);
+    analysis.constantRegisters = ARENA_ALLOCATE(arena, int, constants);
+    analysis.maxDepth = 0;
+    for (int i = 0; i <= count; i++) {
+        analysis.targets[i] = false;
+        analysis.targetDepths[i] = -1;
+    }
+    for (int i = 0; i < constants; i++) analysis.constantRegisters[i] = -1;
+
+    Translator tr;
+    memset(&tr, 0, sizeof(tr));
+    tr.chunk = chunk;
+    tr.arena = arena;
+    tr.analysis = &analysis;
+    tr.lastWriter = -1;
+    tr.offsets = ARENA_ALLOCATE(arena, int, count + 1);
+
+    bool translated = analyze(chunk, &analysis) && translate(&tr);
+    if (translated) {
+        replaceCode(chunk, tr.code, tr.lines, tr.count);
+        chunk->registerCode = true;
+    }
+    return translated;
+}
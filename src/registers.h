@@ -0,0 +1,16 @@
+#ifndef clox_registers_h
+#define clox_registers_h
+
+#include "arena.h"
+#include "chunk.h"
+
+// rewrites the stack code of chunk as register code. every stack slot
+// becomes a register, and so does every constant the code pushes, above
+// the deepest slot. loads of locals and constants are folded into the
+// instructions that use them, and a store to a local into the
+// instruction computing the value, so `x = a + b;` is a single REG_ADD.
+// leaves the chunk as it is and returns false if the registers don't
+// fit in an operand byte. scratch memory comes from arena.
+bool translateToRegisters(Chunk* chunk, Arena* arena);
+
+#endif
@@ -0,0 +1,248 @@
+#include "runner.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vm.h"
+
+// a chase-lev deque of script indices. the owner pops from the bottom,
+// idle workers steal from the top. all tasks are pushed before the
+// workers start, so it never has to grow.
+typedef struct {
+    atomic_long top;
+    atomic_long bottom;
+    int* tasks;
+} TaskDeque;
+
+typedef struct {
+    char* output;
+    size_t outputLength;
+    char* errors;
+    size_t errorLength;
+    int status;
+    bool done;
+} ScriptResult;
+
+typedef struct Runner Runner;
+
+typedef struct {
+    Runner* runner;
+    uint32_t seed;
+    TaskDeque deque;
+    pthread_t thread;
+} Worker;
+
+struct Runner {
+    const char** paths;
+    Budget budget;
+    int optLevel;
+    ScriptResult* results;
+    int workerCount;
+    Worker* workers;
+    pthread_mutex_t lock;
+    pthread_cond_t scriptDone;
+};
+
+static void initDeque(TaskDeque* deque, int capacity) {
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    deque->tasks = malloc(sizeof(int) * (capacity > 0 ? capacity : 1));
+}
+
+// only called before the workers start
+static void pushTask(TaskDeque* deque, int task) {
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    deque->tasks[bottom] = task;
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+static bool popTask(TaskDeque* deque, int* task) {
+    long bottom =
+        atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1,
+                              memory_order_relaxed);
+        return false;
+    }
+    *task = deque->tasks[bottom];
+    if (top < bottom) return true;
+
+    // the last task, a thief may be taking it at the same time
+    bool won = atomic_compare_exchange_strong_explicit(
+        &deque->top, &top, top + 1, memory_order_seq_cst,
+        memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return won;
+}
+
+static bool stealTask(TaskDeque* deque, int* task, bool* sawWork) {
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) return false;
+    *sawWork = true;
+    int value = deque->tasks[top];
+    if (!atomic_compare_exchange_strong_explicit(
+            &deque->top, &top, top + 1, memory_order_seq_cst,
+            memory_order_relaxed)) {
+        return false;
+    }
+    *task = value;
+    return true;
+}
+
+static bool nextTask(Worker* worker, int* task) {
+    if (popTask(&worker->deque, task)) return true;
+
+    Runner* runner = worker->runner;
+    for (;;) {
+        // start at a random victim so thieves spread out
+        worker->seed ^= worker->seed << 13;
+        worker->seed ^= worker->seed >> 17;
+        worker->seed ^= worker->seed << 5;
+        int start = worker->seed % runner->workerCount;
+        bool sawWork = false;
+        for (int i = 0; i < runner->workerCount; i++) {
+            Worker* victim =
+                &runner->workers[(start + i) % runner->workerCount];
+            if (victim == worker) continue;
+            if (stealTask(&victim->deque, task, &sawWork)) return true;
+        }
+        // no new tasks ever show up, so empty deques mean we are done
+        if (!sawWork) return false;
+    }
+}
+
+static char* readScript(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    fseek(file, 0L, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file);
+    char* buffer = malloc(fileSize + 1);
+    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+    buffer[bytesRead] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+static void runScript(Runner* runner, VM* vm, int index) {
+    ScriptResult* result = &runner->results[index];
+    FILE* output = open_memstream(&result->output, &result->outputLength);
+    FILE* errors = open_memstream(&result->errors, &result->errorLength);
+
+    char* source = readScript(runner->paths[index]);
+    if (source == NULL) {
+        fprintf(errors, "Could not open file \"%s\".\n",
+                runner->paths[index]);
+        result->status = 74;
+    } else {
+        initOutput(&vm->output, output);
+        vm->errorFile = errors;
+        setBudget(vm, runner->budget);
+        InterpretResult status = interpret(vm, source);
+        if (status == INTERPRET_BUDGET_EXHAUSTED) {
+            fprintf(errors, "Script ran out of its budget.\n");
+        }
+        result->status = status == INTERPRET_COMPILE_ERROR      ? 65
+                         : status == INTERPRET_RUNTIME_ERROR    ? 70
+                         : status == INTERPRET_BUDGET_EXHAUSTED ? 124
+                                                                : 0;
+        free(source);
+    }
+    fclose(output);
+    fclose(errors);
+
+    pthread_mutex_lock(&runner->lock);
+    result->done = true;
+    pthread_cond_broadcast(&runner->scriptDone);
+    pthread_mutex_unlock(&runner->lock);
+}
+
+static void* runWorker(void* argument) {
+    Worker* worker = (Worker*)argument;
+    VM vm;
+    initVM(&vm);
+    vm.optLevel = worker->runner->optLevel;
+    int task;
+    while (nextTask(worker, &task)) {
+        runScript(worker->runner, &vm, task);
+        resetVM(&vm);
+    }
+    freeVM(&vm);
+    return NULL;
+}
+
+int runScripts(const char** paths, int count, int jobs, Budget budget,
+               int optLevel) {
+    if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > count) jobs = count;
+    if (jobs < 1) jobs = 1;
+
+    Runner runner;
+    runner.paths = paths;
+    runner.budget = budget;
+    runner.optLevel = optLevel;
+    runner.results = calloc(count, sizeof(ScriptResult));
+    runner.workerCount = jobs;
+    runner.workers = malloc(sizeof(Worker) * jobs);
+    pthread_mutex_init(&runner.lock, NULL);
+    pthread_cond_init(&runner.scriptDone, NULL);
+
+    for (int i = 0; i < jobs; i++) {
+        Worker* worker = &runner.workers[i];
+        worker->runner = &runner;
+        worker->seed = 2463534242u + i;
+        initDeque(&worker->deque, count / jobs + 1);
+    }
+    // dealt out round robin and pushed last first, so that every worker
+    // pops its scripts in order and the output can be written early
+    for (int i = count - 1; i >= 0; i--) {
+        pushTask(&runner.workers[i % jobs].deque, i);
+    }
+    for (int i = 0; i < jobs; i++) {
+        pthread_create(&runner.workers[i].thread, NULL, runWorker,
+                       &runner.workers[i]);
+    }
+
+    int exitStatus = 0;
+    for (int i = 0; i < count; i++) {
+        ScriptResult* result = &runner.results[i];
+        pthread_mutex_lock(&runner.lock);
+        while (!result->done) {
+            pthread_cond_wait(&runner.scriptDone, &runner.lock);
+        }
+        pthread_mutex_unlock(&runner.lock);
+
+        fwrite(result->output, 1, result->outputLength, stdout);
+        if (result->errorLength > 0 || result->status != 0) {
+            // keep errors next to the output of the same script
+            fflush(stdout);
+            fwrite(result->errors, 1, result->errorLength, stderr);
+        }
+        if (result->status != 0) {
+            fprintf(stderr, "%s: exit status %d\n", paths[i],
+                    result->status);
+            if (exitStatus == 0) exitStatus = result->status;
+        }
+        free(result->output);
+        free(result->errors);
+    }
+    fflush(stdout);
+
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(runner.workers[i].thread, NULL);
+        free(runner.workers[i].deque.tasks);
+    }
+    pthread_cond_destroy(&runner.scriptDone);
+    pthread_mutex_destroy(&runner.lock);
+    free(runner.workers);
+    free(runner.results);
+    return exitStatus;
+}
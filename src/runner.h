@@ -0,0 +1,17 @@
+#ifndef clox_runner_h
+#define clox_runner_h
+
+#include "common.h"
+#include "vm.h"
+
+// runs every script on a pool of worker threads, each with a vm of its
+// own that is reset between scripts. the output and errors of each
+// script are written in the order of paths as soon as it and all the
+// scripts before it are done. jobs <= 0 uses one worker per core.
+// every script is compiled at optLevel and gets the same budget, one
+// that runs out of it fails with status 124. returns the exit status of
+// the first script that failed, 0 if none did.
+int runScripts(const char** paths, int count, int jobs, Budget budget,
+               int optLevel);
+
+#endif
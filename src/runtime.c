@@ -0,0 +1,56 @@
+#include "runtime.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "memory.h"
+
+void initRuntime(VM* vm) {
+    memset(vm, 0, sizeof(VM));
+    initMap(&vm->strings);
+    initMap(&vm->globals);
+    initOutput(&vm->output, stdout);
+    vm->errorFile = stderr;
+}
+
+int freeRuntime(VM* vm, int status) {
+    flushOutput(&vm->output);
+    freeMap(&vm->strings);
+    freeMap(&vm->globals);
+    freeObjects(vm);
+    return status;
+}
+
+void reportError(VM* vm, int line, const char* format, ...) {
+    flushOutput(&vm->output);
+    va_list args;
+    va_start(args, format);
+    vfprintf(vm->errorFile, format, args);
+    va_end(args);
+    fprintf(vm->errorFile, "\n[line %d] in script\n", line);
+}
+
+Value runtimeConcatenate(VM* vm, Value a, Value b) {
+    ObjString* left = AS_STRING(a);
+    ObjString* right = AS_STRING(b);
+    int length = left->length + right->length;
+    char* chars = ALLOCATE(char, length + 1);
+    memcpy(chars, left->chars, left->length);
+    memcpy(chars + left->length, right->chars, right->length);
+    chars[length] = '\0';
+    return OBJ_VAL(takeString(vm, chars, length));
+}
+
+Entry* runtimeGlobal(VM* vm, ObjString* name, Entry** cache) {
+    // the same test as the interpreter's global cache
+    Map* globals = &vm->globals;
+    Entry* entry = *cache;
+    if (entry >= globals->entries &&
+        entry < globals->entries + globals->capacity &&
+        entry->key == name) {
+        return entry;
+    }
+    entry = mapFindEntry(globals, name);
+    *cache = entry;
+    return entry;
+}
@@ -0,0 +1,33 @@
+#ifndef clox_runtime_h
+#define clox_runtime_h
+
+// what the c that clox --emit-c writes runs against: a vm without the
+// interpreter, holding only strings, arrays, globals and output. it is
+// built from value.c, object.c, map.c, memory.c and the natives with
+// the few files they need, see the //:clox_runtime target.
+
+#include "array.h"
+#include "map.h"
+#include "natives.h"
+#include "object.h"
+#include "output.h"
+#include "value.h"
+#include "vm.h"
+
+void initRuntime(VM* vm);
+// flushes the output, frees everything the program made and returns
+// status, the exit status of the program
+int freeRuntime(VM* vm, int status);
+// reports an error at line the way the interpreter does
+void reportError(VM* vm, int line, const char* format, ...);
+// a + b for two strings
+Value runtimeConcatenate(VM* vm, Value a, Value b);
+// the entry of the global name, NULL if it isn't defined. cache holds
+// the entry last found for name, it stays good until the globals grow.
+Entry* runtimeGlobal(VM* vm, ObjString* name, Entry** cache);
+
+static inline bool runtimeFalsey(Value value) {
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include "sampler.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "memory.h"
+#include "vm.h"
+
+#define RING_SIZE 4096
+
+typedef struct {
+    int line;
+    uint64_t count;
+} StackCount;
+
+// single producer (the signal handler), single consumer (drainSamples)
+// holds the source line of each sample, -1 when no chunk was running
+static int ring[RING_SIZE];
+static atomic_uint ringHead;
+static atomic_uint ringTail;
+static atomic_ulong droppedSamples;
+
+volatile sig_atomic_t samplerNeedsDrain = 0;
+
+static VM* volatile sampledVM = NULL;
+static const char* rootName;
+static bool running = false;
+static struct sigaction oldAction;
+
+static int stackCount = 0;
+static int stackCapacity = 0;
+static StackCount* stacks = NULL;
+static uint64_t idleSamples = 0;
+
+static void handleSignal(int signal) {
+    (void)signal;
+    VM* vm = sampledVM;
+    if (vm == NULL) return;
+    // reads the ip as the dispatch loop last stored it
+    Chunk* chunk = *(Chunk* volatile*)&vm->chunk;
+    uint8_t* ip = *(uint8_t* volatile*)&vm->ip;
+    int line = -1;
+    if (chunk != NULL && ip > chunk->code && ip <= chunk->code + chunk->count) {
+        // ip may sit anywhere inside the instruction, so only the line is
+        // reliable, operands share it with their opcode
+        line = chunk->lines[ip - chunk->code - 1];
+    }
+
+    unsigned head = atomic_load_explicit(&ringHead, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ringTail, memory_order_acquire);
+    if (head - tail >= RING_SIZE) {
+        atomic_fetch_add_explicit(&droppedSamples, 1, memory_order_relaxed);
+        return;
+    }
+    ring[head % RING_SIZE] = line;
+    atomic_store_explicit(&ringHead, head + 1, memory_order_release);
+    if (head + 1 - tail >= RING_SIZE / 2) {
+        samplerNeedsDrain = 1;
+    }
+}
+
+bool startSampler(VM* vm, const char* name, int hz) {
+    if (running || hz <= 0) return false;
+    sampledVM = vm;
+    rootName = name;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &oldAction) != 0) return false;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        sigaction(SIGPROF, &oldAction, NULL);
+        sampledVM = NULL;
+        return false;
+    }
+    running = true;
+    return true;
+}
+
+void stopSampler() {
+    if (!running) return;
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &oldAction, NULL);
+    sampledVM = NULL;
+    running = false;
+    drainSamples();
+}
+
+static void countSample(int line) {
+    if (line < 0) {
+        idleSamples++;
+        return;
+    }
+    for (int i = 0; i < stackCount; i++) {
+        if (stacks[i].line == line) {
+            stacks[i].count++;
+            return;
+        }
+    }
+    if (stackCapacity < stackCount + 1) {
+        int oldCapacity = stackCapacity;
+        stackCapacity = GROW_CAPACITY(oldCapacity);
+        stacks = GROW_ARRAY(StackCount, stacks, oldCapacity, stackCapacity);
+    }
+    stacks[stackCount++] = (StackCount){line, 1};
+}
+
+void drainSamples() {
+    samplerNeedsDrain = 0;
+    unsigned tail = atomic_load_explicit(&ringTail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ringHead, memory_order_acquire);
+    while (tail != head) {
+        countSample(ring[tail % RING_SIZE]);
+        tail++;
+    }
+    atomic_store_explicit(&ringTail, tail, memory_order_release);
+}
+
+void writeCollapsedStacks(FILE* file) {
+    drainSamples();
+    for (int i = 0; i < stackCount; i++) {
+        fprintf(file, "%s;line %d %llu\n", rootName, stacks[i].line,
+                (unsigned long long)stacks[i].count);
+    }
+    if (idleSamples > 0) {
+        // time spent compiling or outside of run()
+        fprintf(file, "%s;[native] %llu\n", rootName,
+                (unsigned long long)idleSamples);
+    }
+    unsigned long dropped = atomic_load(&droppedSamples);
+    if (dropped > 0) {
+        fprintf(stderr, "sampler: dropped %lu samples\n", dropped);
+    }
+}
+
+void freeSampler() {
+    FREE_ARRAY(StackCount, stacks, stackCapacity);
+    stacks = NULL;
+    stackCount = 0;
+    stackCapacity = 0;
+    idleSamples = 0;
+}
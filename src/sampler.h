@@ -0,0 +1,27 @@
+#ifndef clox_sampler_h
+#define clox_sampler_h
+
+#include <signal.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "object.h"
+
+#define SAMPLER_DEFAULT_HZ 1000
+
+// set from the signal handler once the ring buffer is half full, the vm
+// drains it at the next backward jump
+extern volatile sig_atomic_t samplerNeedsDrain;
+
+// starts sampling the script vm runs with SIGPROF, name labels the root
+// frame of every stack. the timer is process wide, so only one vm at a
+// time can be sampled.
+bool startSampler(VM* vm, const char* name, int hz);
+void stopSampler();
+// moves samples out of the ring buffer into the totals
+void drainSamples();
+// writes the totals in the collapsed stack format flamegraph.pl reads
+void writeCollapsedStacks(FILE* file);
+void freeSampler();
+
+#endif
@@ -3,149 +3,261 @@
 #include <string.h>
 
 #include "common.h"
+#include "memory.h"
 
-typedef struct {
-    const char* start;
-    const char* current;
-    int line;
-} Scanner;
-
-Scanner scanner;
+#if defined(__AVX2__)
+#include <immintrin.h>
+typedef __m256i ScanBlock;
+#define SCAN_WIDTH 32
+#define BLOCK_FULL_MASK 0xffffffffu
+#define LOAD_BLOCK(p) _mm256_loadu_si256((const __m256i*)(p))
+#define SPLAT(c) _mm256_set1_epi8((char)(c))
+#define EQ_BLOCK(a, b) _mm256_cmpeq_epi8((a), (b))
+#define GT_BLOCK(a, b) _mm256_cmpgt_epi8((a), (b))
+#define AND_BLOCK(a, b) _mm256_and_si256((a), (b))
+#define OR_BLOCK(a, b) _mm256_or_si256((a), (b))
+#define MASK_BLOCK(a) ((uint32_t)_mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128i ScanBlock;
+#define SCAN_WIDTH 16
+#define BLOCK_FULL_MASK 0xffffu
+#define LOAD_BLOCK(p) _mm_loadu_si128((const __m128i*)(p))
+#define SPLAT(c) _mm_set1_epi8((char)(c))
+#define EQ_BLOCK(a, b) _mm_cmpeq_epi8((a), (b))
+#define GT_BLOCK(a, b) _mm_cmpgt_epi8((a), (b))
+#define AND_BLOCK(a, b) _mm_and_si128((a), (b))
+#define OR_BLOCK(a, b) _mm_or_si128((a), (b))
+#define MASK_BLOCK(a) ((uint32_t)_mm_movemask_epi8(a))
+#endif
 
-static char advance() {
-    scanner.current++;
-    return scanner.current[-1];
+static char advance(Scanner* scanner) {
+    scanner->current++;
+    return scanner->current[-1];
 }
 
-static bool match(char expected) {
-    if (isAtEnd()) return false;
-    if (*scanner.current != expected) return false;
-    scanner.current++;
+static bool match(Scanner* scanner, char expected) {
+    if (isAtEnd(scanner)) return false;
+    if (*scanner->current != expected) return false;
+    scanner->current++;
     return true;
 }
 
-static char peek() { return *scanner.current; }
-static char peekNext() {
-    if (isAtEnd()) return '\0';
-    return scanner.current[1];
+static char peek(Scanner* scanner) { return *scanner->current; }
+static char peekNext(Scanner* scanner) {
+    if (isAtEnd(scanner)) return '\0';
+    return scanner->current[1];
 }
 static bool isDigit(char c) { return c >= '0' && c <= '9'; }
 static bool isAlpha(char c) {
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
 }
 
-static TokenType checkKeyword(int start, int length, const char* rest,
-                              TokenType type) {
-    int tokenLength = scanner.current - scanner.start;
-    const expectedLength = start + length;
+// keywords are resolved with a perfect hash over the first two
+// characters and the length. the multipliers were picked so that no two
+// keywords share a slot, the table itself is laid out by the compiler
+// (a collision shows up as an -Woverride-init warning).
+#define KEYWORD_HASH(c0, c1, length) \
+    ((((uint8_t)(c0) << 2) + (uint8_t)(c1) * 3 + (length)) & 31)
+#define KEYWORD(c0, c1, name, type) \
+    [KEYWORD_HASH(c0, c1, sizeof(name) - 1)] = {name, sizeof(name) - 1, type}
 
-    if (tokenLength == expectedLength &&
-        memcmp(scanner.start + start, rest, length) == 0) {
-        return type;
-    }
+typedef struct {
+    const char* name;
+    int length;
+    TokenType type;
+} Keyword;
+
+static const Keyword keywords[32] = {
+    KEYWORD('a', 'n', "and", TOKEN_AND),
+    KEYWORD('c', 'l', "class", TOKEN_CLASS),
+    KEYWORD('e', 'l', "else", TOKEN_ELSE),
+    KEYWORD('f', 'a', "false", TOKEN_FALSE),
+    KEYWORD('f', 'o', "for", TOKEN_FOR),
+    KEYWORD('f', 'u', "fun", TOKEN_FUN),
+    KEYWORD('i', 'f', "if", TOKEN_IF),
+    KEYWORD('n', 'i', "nil", TOKEN_NIL),
+    KEYWORD('o', 'r', "or", TOKEN_OR),
+    KEYWORD('p', 'r', "print", TOKEN_PRINT),
+    KEYWORD('r', 'e', "return", TOKEN_RETURN),
+    KEYWORD('s', 'u', "super", TOKEN_SUPER),
+    KEYWORD('t', 'h', "this", TOKEN_THIS),
+    KEYWORD('t', 'r', "true", TOKEN_TRUE),
+    KEYWORD('v', 'a', "var", TOKEN_VAR),
+    KEYWORD('w', 'h', "while", TOKEN_WHILE),
+};
 
+#undef KEYWORD
+
+static TokenType identiferType(Scanner* scanner) {
+    int length = (int)(scanner->current - scanner->start);
+    if (length < 2 || length > 6) {
+        return TOKEN_IDENTIFIER;
+    }
+    const Keyword* keyword =
+        &keywords[KEYWORD_HASH(scanner->start[0], scanner->start[1], length)];
+    if (keyword->length == length &&
+        memcmp(scanner->start, keyword->name, length) == 0) {
+        return keyword->type;
+    }
     return TOKEN_IDENTIFIER;
 }
 
-static TokenType identiferType() {
-    switch (scanner.start[0]) {
-        case 'a':
-            return checkKeyword(1, 2, "nd", TOKEN_AND);
-        case 'c':
-            return checkKeyword(1, 4, "lass", TOKEN_CLASS);
-        case 'e':
-            return checkKeyword(1, 3, "lse", TOKEN_ELSE);
-        case 'f':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a':
-                        return checkKeyword(2, 3, "lse", TOKEN_FALSE);
-                    case 'o':
-                        return checkKeyword(2, 1, "r", TOKEN_FOR);
-                    case 'u':
-                        return checkKeyword(2, 1, "n", TOKEN_FUN);
-                }
-            }
-            break;
-        case 'i':
-            return checkKeyword(1, 1, "f", TOKEN_IF);
-        case 'n':
-            return checkKeyword(1, 2, "il", TOKEN_NIL);
-        case 'o':
-            return checkKeyword(1, 1, "r", TOKEN_OR);
-        case 'p':
-            return checkKeyword(1, 4, "rint", TOKEN_PRINT);
-        case 'r':
-            return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
-        case 's':
-            return checkKeyword(1, 4, "uper", TOKEN_SUPER);
-        case 't':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'h':
-                        return checkKeyword(2, 2, "is", TOKEN_THIS);
-                    case 'r':
-                        return checkKeyword(2, 2, "ue", TOKEN_TRUE);
-                }
-            }
-            break;
-        case 'v':
-            return checkKeyword(1, 2, "ar", TOKEN_VAR);
-        case 'w':
-            return checkKeyword(1, 4, "hile", TOKEN_WHILE);
+#ifdef SCAN_WIDTH
+// whether a whole block from the current position lies in the source,
+// its terminating '\0' included. the last bytes are left to the scalar
+// loops so that no load reads past the end.
+static inline bool canLoadBlock(const Scanner* scanner) {
+    return scanner->end - scanner->current >= SCAN_WIDTH - 1;
+}
 
-        default:
-            return TOKEN_IDENTIFIER;
-    }
+static int countBits(uint32_t bits) {
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1) count++;
+    return count;
 }
 
-static Token identifier() {
-    while (isAlpha(peek()) || isDigit(peek())) {
-        advance();
+// one bit per byte in the block, set for the bytes that can't be part of
+// an identifier body. '\0' and non-ascii bytes are never identifier bytes.
+static inline uint32_t identifierStopMask(const char* p) {
+    ScanBlock c = LOAD_BLOCK(p);
+    ScanBlock lower = OR_BLOCK(c, SPLAT(0x20));
+    ScanBlock alpha = AND_BLOCK(GT_BLOCK(lower, SPLAT('a' - 1)),
+                                GT_BLOCK(SPLAT('z' + 1), lower));
+    ScanBlock digit = AND_BLOCK(GT_BLOCK(c, SPLAT('0' - 1)),
+                                GT_BLOCK(SPLAT('9' + 1), c));
+    ScanBlock underscore = EQ_BLOCK(c, SPLAT('_'));
+    return ~MASK_BLOCK(OR_BLOCK(OR_BLOCK(alpha, digit), underscore)) &
+           BLOCK_FULL_MASK;
+}
+
+static inline uint32_t whitespaceMask(const char* p, uint32_t* newlines) {
+    ScanBlock c = LOAD_BLOCK(p);
+    ScanBlock nl = EQ_BLOCK(c, SPLAT('\n'));
+    ScanBlock ws = OR_BLOCK(OR_BLOCK(EQ_BLOCK(c, SPLAT(' ')), nl),
+                            OR_BLOCK(EQ_BLOCK(c, SPLAT('\t')),
+                                     EQ_BLOCK(c, SPLAT('\r'))));
+    *newlines = MASK_BLOCK(nl);
+    return MASK_BLOCK(ws);
+}
+
+static inline uint32_t stringEndMask(const char* p, uint32_t* newlines) {
+    ScanBlock c = LOAD_BLOCK(p);
+    *newlines = MASK_BLOCK(EQ_BLOCK(c, SPLAT('\n')));
+    return MASK_BLOCK(
+        OR_BLOCK(EQ_BLOCK(c, SPLAT('"')), EQ_BLOCK(c, SPLAT('\0'))));
+}
+
+static inline uint32_t lineEndMask(const char* p) {
+    ScanBlock c = LOAD_BLOCK(p);
+    return MASK_BLOCK(
+        OR_BLOCK(EQ_BLOCK(c, SPLAT('\n')), EQ_BLOCK(c, SPLAT('\0'))));
+}
+#endif
+
+static Token identifier(Scanner* scanner) {
+#ifdef SCAN_WIDTH
+    while (canLoadBlock(scanner)) {
+        uint32_t stop = identifierStopMask(scanner->current);
+        if (stop != 0) {
+            scanner->current += __builtin_ctz(stop);
+            return makeToken(scanner, identiferType(scanner));
+        }
+        scanner->current += SCAN_WIDTH;
+    }
+#endif
+    while (isAlpha(peek(scanner)) || isDigit(peek(scanner))) {
+        advance(scanner);
     }
-    return makeToken(identiferType());
+    return makeToken(scanner, identiferType(scanner));
 }
 
-static Token number() {
-    while (isDigit(peek())) {
-        advance();
+static Token number(Scanner* scanner) {
+    while (isDigit(peek(scanner))) {
+        advance(scanner);
     }
-    if (peek() == '.' && isDigit(peekNext())) advance();
-    while (isDigit(peek())) {
-        advance();
+    if (peek(scanner) == '.' && isDigit(peekNext(scanner))) advance(scanner);
+    while (isDigit(peek(scanner))) {
+        advance(scanner);
     }
-    return makeToken(TOKEN_NUMBER);
+    return makeToken(scanner, TOKEN_NUMBER);
 }
 
-static Token string() {
-    while (peek() != '"' && !isAtEnd()) {
-        if (peek() == '\n') scanner.line++;
-        advance();
+static Token string(Scanner* scanner) {
+#ifdef SCAN_WIDTH
+    while (canLoadBlock(scanner)) {
+        uint32_t newlines;
+        uint32_t end = stringEndMask(scanner->current, &newlines);
+        if (end != 0) {
+            int skip = __builtin_ctz(end);
+            scanner->line += countBits(newlines & ((1u << skip) - 1));
+            scanner->current += skip;
+            break;
+        }
+        scanner->line += countBits(newlines);
+        scanner->current += SCAN_WIDTH;
     }
-    if (isAtEnd()) {
-        return errorToken("Unterminated string.");
+#endif
+    while (peek(scanner) != '"' && !isAtEnd(scanner)) {
+        if (peek(scanner) == '\n') scanner->line++;
+        advance(scanner);
+    }
+    if (isAtEnd(scanner)) {
+        return errorToken(scanner, "Unterminated string.");
     }
     // eat the closing quote
-    advance();
-    return makeToken(TOKEN_STRING);
+    advance(scanner);
+    return makeToken(scanner, TOKEN_STRING);
 }
 
-void skipWhitespace() {
-    for (;;) {
-        char c = peek();
-        if (c == ' ' || c == '\r' || c == '\t') {
-            advance();
+#ifdef SCAN_WIDTH
+// consumes whole blocks of blanks at once (indentation, blank lines),
+// counting the newlines we step over
+static void skipBlankRun(Scanner* scanner) {
+    while (canLoadBlock(scanner)) {
+        uint32_t newlines;
+        uint32_t blanks = whitespaceMask(scanner->current, &newlines);
+        if (blanks == BLOCK_FULL_MASK) {
+            scanner->line += countBits(newlines);
+            scanner->current += SCAN_WIDTH;
             continue;
         }
-        if (c == '\n') {
-            scanner.line += 1;
-            advance();
+        int skip = __builtin_ctz(~blanks);
+        scanner->line += countBits(newlines & ((1u << skip) - 1));
+        scanner->current += skip;
+        return;
+    }
+}
+#endif
+
+static void skipWhitespace(Scanner* scanner) {
+    for (;;) {
+        char c = peek(scanner);
+        if (c == ' ' || c == '\r' || c == '\t' || c == '\n') {
+            if (c == '\n') scanner->line += 1;
+            advance(scanner);
+#ifdef SCAN_WIDTH
+            // a single blank between tokens is the common case, only
+            // go wide for longer runs
+            c = peek(scanner);
+            if (c == ' ' || c == '\t' || c == '\n') skipBlankRun(scanner);
+#endif
             continue;
         }
         if (c == '/') {
-            if (peekNext() == '/') {
-                while (peek() != '\n' && !isAtEnd()) {
-                    advance();
+            if (peekNext(scanner) == '/') {
+#ifdef SCAN_WIDTH
+                while (canLoadBlock(scanner)) {
+                    uint32_t end = lineEndMask(scanner->current);
+                    if (end != 0) {
+                        scanner->current += __builtin_ctz(end);
+                        break;
+                    }
+                    scanner->current += SCAN_WIDTH;
+                }
+#endif
+                while (peek(scanner) != '\n' && !isAtEnd(scanner)) {
+                    advance(scanner);
                 }
                 continue;
             } else {
@@ -156,80 +268,206 @@ void skipWhitespace() {
     }
 }
 
-Token errorToken(const char* message) {
+Token errorToken(Scanner* scanner, const char* message) {
     Token token;
     token.type = TOKEN_ERROR;
     token.start = message;
     token.length = (int)strlen(message);
-    token.line = scanner.line;
+    token.line = scanner->line;
     return token;
 }
 
-bool isAtEnd() { return *(scanner.current) == '\0'; }
+bool isAtEnd(Scanner* scanner) { return *(scanner->current) == '\0'; }
 
-Token makeToken(TokenType type) {
+Token makeToken(Scanner* scanner, TokenType type) {
     Token token;
-    token.line = scanner.line;
+    token.line = scanner->line;
     token.type = type;
-    token.start = scanner.start;
-    token.length = (int)(scanner.current - scanner.start);
+    token.start = scanner->start;
+    token.length = (int)(scanner->current - scanner->start);
     return token;
 }
 
-void initScanner(const char* source) {
-    scanner.start = source;
-    scanner.current = source;
-    scanner.line = 1;
+void initScanner(Scanner* scanner, const char* source) {
+    scanner->start = source;
+    scanner->current = source;
+    scanner->end = source + strlen(source);
+    scanner->line = 1;
 }
 
-Token scanToken() {
-    skipWhitespace();
-    scanner.start = scanner.current;
-    if (isAtEnd()) {
-        return makeToken(TOKEN_EOF);
+Token scanToken(Scanner* scanner) {
+    skipWhitespace(scanner);
+    scanner->start = scanner->current;
+    if (isAtEnd(scanner)) {
+        return makeToken(scanner, TOKEN_EOF);
     }
-    char c = advance();
+    char c = advance(scanner);
     if (isAlpha(c)) {
-        return identifier();
+        return identifier(scanner);
     }
     if (isDigit(c)) {
-        return number();
+        return number(scanner);
     }
     switch (c) {
         case '(':
-            return makeToken(TOKEN_LEFT_PAREN);
+            return makeToken(scanner, TOKEN_LEFT_PAREN);
         case ')':
-            return makeToken(TOKEN_RIGHT_PAREN);
+            return makeToken(scanner, TOKEN_RIGHT_PAREN);
         case '{':
-            return makeToken(TOKEN_LEFT_BRACE);
+            return makeToken(scanner, TOKEN_LEFT_BRACE);
         case '}':
-            return makeToken(TOKEN_RIGHT_BRACE);
+            return makeToken(scanner, TOKEN_RIGHT_BRACE);
         case ';':
-            return makeToken(TOKEN_SEMICOLON);
+            return makeToken(scanner, TOKEN_SEMICOLON);
         case ',':
-            return makeToken(TOKEN_COMMA);
+            return makeToken(scanner, TOKEN_COMMA);
         case '.':
-            return makeToken(TOKEN_DOT);
+            return makeToken(scanner, TOKEN_DOT);
         case '-':
-            return makeToken(TOKEN_MINUS);
+            return makeToken(scanner, TOKEN_MINUS);
         case '+':
-            return makeToken(TOKEN_PLUS);
+            return makeToken(scanner, TOKEN_PLUS);
         case '/':
-            return makeToken(TOKEN_SLASH);
+            return makeToken(scanner, TOKEN_SLASH);
         case '*':
-            return makeToken(TOKEN_STAR);
+            return makeToken(scanner, TOKEN_STAR);
+        case '[':
+            return makeToken(scanner, TOKEN_LEFT_BRACKET);
+        case ']':
+            return makeToken(scanner, TOKEN_RIGHT_BRACKET);
         case '!':
-            return makeToken(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_BANG_EQUAL
+                                                          : TOKEN_BANG);
         case '<':
-            return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_LESS_EQUAL
+                                                          : TOKEN_LESS);
         case '>':
-            return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_GREATER_EQUAL
+                                                          : TOKEN_GREATER);
         case '=':
-            return makeToken(match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
+            return makeToken(scanner, match(scanner, '=') ? TOKEN_EQUAL_EQUAL
+                                                          : TOKEN_EQUAL);
         case '"':
-            return string();
+            return string(scanner);
         default:
             break;
     }
-    return errorToken("Unexpected character.");
-}
\ No newline at end of file
+    return errorToken(scanner, "Unexpected character.");
+}
+
+void initTokenBuffer(TokenBuffer* buffer) {
+    buffer->count = 0;
+    buffer->capacity = 0;
+    buffer->types = NULL;
+    buffer->offsets = NULL;
+    buffer->lengths = NULL;
+    buffer->lineCount = 0;
+    buffer->lineCapacity = 0;
+    buffer->lineTokens = NULL;
+    buffer->lines = NULL;
+    buffer->errorCount = 0;
+    buffer->errorCapacity = 0;
+    buffer->errors = NULL;
+    buffer->source = NULL;
+}
+
+void freeTokenBuffer(TokenBuffer* buffer) {
+    FREE_ARRAY(uint8_t, buffer->types, buffer->capacity);
+    FREE_ARRAY(uint32_t, buffer->offsets, buffer->capacity);
+    FREE_ARRAY(uint32_t, buffer->lengths, buffer->capacity);
+    FREE_ARRAY(uint32_t, buffer->lineTokens, buffer->lineCapacity);
+    FREE_ARRAY(int, buffer->lines, buffer->lineCapacity);
+    FREE_ARRAY(const char*, buffer->errors, buffer->errorCapacity);
+    initTokenBuffer(buffer);
+}
+
+static void growTokens(TokenBuffer* buffer, int capacity) {
+    int oldCapacity = buffer->capacity;
+    buffer->capacity = capacity;
+    buffer->types =
+        GROW_ARRAY(uint8_t, buffer->types, oldCapacity, buffer->capacity);
+    buffer->offsets =
+        GROW_ARRAY(uint32_t, buffer->offsets, oldCapacity, buffer->capacity);
+    buffer->lengths =
+        GROW_ARRAY(uint32_t, buffer->lengths, oldCapacity, buffer->capacity);
+}
+
+static void writeLineRun(TokenBuffer* buffer, int line) {
+    if (buffer->lineCapacity < buffer->lineCount + 1) {
+        int oldCapacity = buffer->lineCapacity;
+        buffer->lineCapacity = GROW_CAPACITY(oldCapacity);
+        buffer->lineTokens = GROW_ARRAY(uint32_t, buffer->lineTokens,
+                                        oldCapacity, buffer->lineCapacity);
+        buffer->lines =
+            GROW_ARRAY(int, buffer->lines, oldCapacity, buffer->lineCapacity);
+    }
+    buffer->lineTokens[buffer->lineCount] = buffer->count;
+    buffer->lines[buffer->lineCount] = line;
+    buffer->lineCount++;
+}
+
+static uint32_t writeError(TokenBuffer* buffer, const char* message) {
+    if (buffer->errorCapacity < buffer->errorCount + 1) {
+        int oldCapacity = buffer->errorCapacity;
+        buffer->errorCapacity = GROW_CAPACITY(oldCapacity);
+        buffer->errors = GROW_ARRAY(const char*, buffer->errors, oldCapacity,
+                                    buffer->errorCapacity);
+    }
+    buffer->errors[buffer->errorCount] = message;
+    return buffer->errorCount++;
+}
+
+void tokenize(TokenBuffer* buffer, const char* source) {
+    // reuse whatever storage the buffer already has
+    buffer->count = 0;
+    buffer->lineCount = 0;
+    buffer->errorCount = 0;
+    buffer->source = source;
+    Scanner scanner;
+    initScanner(&scanner, source);
+    // a rough guess of one token every four bytes saves most regrowth
+    int expected = (int)((scanner.end - source) / 4);
+    if (buffer->capacity < expected) {
+        growTokens(buffer, expected);
+    }
+    for (;;) {
+        Token token = scanToken(&scanner);
+        if (buffer->capacity < buffer->count + 1) {
+            growTokens(buffer, GROW_CAPACITY(buffer->capacity));
+        }
+        if (buffer->lineCount == 0 ||
+            buffer->lines[buffer->lineCount - 1] != token.line) {
+            writeLineRun(buffer, token.line);
+        }
+        buffer->types[buffer->count] = (uint8_t)token.type;
+        buffer->lengths[buffer->count] = (uint32_t)token.length;
+        if (token.type == TOKEN_ERROR) {
+            buffer->offsets[buffer->count] = writeError(buffer, token.start);
+        } else {
+            buffer->offsets[buffer->count] = (uint32_t)(token.start - source);
+        }
+        buffer->count++;
+        if (token.type == TOKEN_EOF) break;
+    }
+}
+
+Token tokenAt(TokenBuffer* buffer, int index, int* run) {
+    while (*run + 1 < buffer->lineCount &&
+           buffer->lineTokens[*run + 1] <= (uint32_t)index) {
+        (*run)++;
+    }
+    while (*run > 0 && buffer->lineTokens[*run] > (uint32_t)index) {
+        (*run)--;
+    }
+
+    Token token;
+    token.type = (TokenType)buffer->types[index];
+    token.length = (int)buffer->lengths[index];
+    token.line = buffer->lines[*run];
+    if (token.type == TOKEN_ERROR) {
+        token.start = buffer->errors[buffer->offsets[index]];
+    } else {
+        token.start = buffer->source + buffer->offsets[index];
+    }
+    return token;
+}
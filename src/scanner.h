@@ -15,6 +15,8 @@ typedef enum {
     TOKEN_SEMICOLON,
     TOKEN_SLASH,
     TOKEN_STAR,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
 
     // ONE_OR_TWO_CHARACTER_TOKEN
     TOKEN_BANG,
@@ -62,9 +64,43 @@ typedef struct {
 
 } Token;
 
-void initScanner(const char* source);
-Token scanToken();
-bool isAtEnd();
-Token makeToken(TokenType type);
-Token errorToken(const char*);
+// a whole source file tokenized up front, stored as parallel arrays.
+// line numbers are run-length encoded: run i covers the tokens starting
+// at lineTokens[i] and all of them are on lines[i].
+typedef struct {
+    int count;
+    int capacity;
+    uint8_t* types;
+    uint32_t* offsets;  // for TOKEN_ERROR, an index into errors instead
+    uint32_t* lengths;
+    int lineCount;
+    int lineCapacity;
+    uint32_t* lineTokens;
+    int* lines;
+    int errorCount;
+    int errorCapacity;
+    const char** errors;
+    const char* source;
+} TokenBuffer;
+
+typedef struct {
+    const char* start;
+    const char* current;
+    // the terminating '\0', no block load goes past it
+    const char* end;
+    int line;
+} Scanner;
+
+void initScanner(Scanner* scanner, const char* source);
+Token scanToken(Scanner* scanner);
+bool isAtEnd(Scanner* scanner);
+Token makeToken(Scanner* scanner, TokenType type);
+Token errorToken(Scanner* scanner, const char* message);
+
+void initTokenBuffer(TokenBuffer* buffer);
+void freeTokenBuffer(TokenBuffer* buffer);
+void tokenize(TokenBuffer* buffer, const char* source);
+// run is a cursor into the line runs, keep passing the same one when
+// reading tokens in order so the lookup stays O(1)
+Token tokenAt(TokenBuffer* buffer, int index, int* run);
 #endif
\ No newline at end of file
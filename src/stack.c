@@ -0,0 +1,70 @@
+#include "stack.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// the guard of the run on this thread, read by the fault handler
+static _Thread_local char* guardStart = NULL;
+static _Thread_local char* guardEnd = NULL;
+static _Thread_local sigjmp_buf* guardJump = NULL;
+
+static pthread_once_t handlerOnce = PTHREAD_ONCE_INIT;
+static struct sigaction oldAction;
+
+static size_t pageSize() { return (size_t)sysconf(_SC_PAGESIZE); }
+
+// the bytes of the values, rounded up to whole pages
+static size_t stackBytes(size_t size) {
+    size_t page = pageSize();
+    return (size * sizeof(Value) + page - 1) / page * page;
+}
+
+Value* mapStack(size_t size) {
+    size_t bytes = stackBytes(size);
+    // the kernel commits pages on first touch
+    char* start = mmap(NULL, bytes + pageSize(), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED) return NULL;
+    if (mprotect(start + bytes, pageSize(), PROT_NONE) != 0) {
+        munmap(start, bytes + pageSize());
+        return NULL;
+    }
+    return (Value*)start;
+}
+
+void unmapStack(Value* stack, size_t size) {
+    munmap(stack, stackBytes(size) + pageSize());
+}
+
+static void handleFault(int signal, siginfo_t* info, void* context) {
+    char* address = (char*)info->si_addr;
+    if (guardJump != NULL && address >= guardStart &&
+        address < guardEnd) {
+        siglongjmp(*guardJump, 1);
+    }
+    // not ours: put back whatever handled it before, returning retries
+    // the faulting instruction
+    (void)context;
+    sigaction(signal, &oldAction, NULL);
+}
+
+static void installHandler() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handleFault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &oldAction);
+}
+
+void enterStackGuard(Value* stack, size_t size, sigjmp_buf* overflow) {
+    pthread_once(&handlerOnce, installHandler);
+    guardStart = (char*)stack + stackBytes(size);
+    guardEnd = guardStart + pageSize();
+    guardJump = overflow;
+}
+
+void leaveStackGuard() { guardJump = NULL; }
@@ -0,0 +1,24 @@
+#ifndef clox_stack_h
+#define clox_stack_h
+
+#include <setjmp.h>
+
+#include "common.h"
+#include "value.h"
+
+// values a vm's stack holds unless setStackSize() says otherwise. only
+// the pages a script touches are ever committed.
+#define STACK_DEFAULT_SIZE (64 * 1024)
+
+// reserves room for size values with a guard page right above them, so
+// pushing past the end faults instead of corrupting memory. NULL if the
+// memory could not be mapped.
+Value* mapStack(size_t size);
+void unmapStack(Value* stack, size_t size);
+
+// while guarded, a fault in the guard page of stack on this thread jumps
+// to overflow. anything else still crashes as usual.
+void enterStackGuard(Value* stack, size_t size, sigjmp_buf* overflow);
+void leaveStackGuard();
+
+#endif
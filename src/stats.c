@@ -0,0 +1,102 @@
+#include "stats.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "debug.h"
+#include "memory.h"
+#include "vm.h"
+
+uint64_t monotonicNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// walks the table, probe lengths aren't tracked on the lookup path
+static void getMapStats(Map* map, MapStats* stats) {
+    stats->count = 0;
+    stats->capacity = map->capacity;
+    stats->tombstones = 0;
+    stats->maxProbe = 0;
+    uint64_t totalProbe = 0;
+    for (int i = 0; i < map->capacity; i++) {
+        Entry* entry = &map->entries[i];
+        if (entry->key == NULL) {
+            if (!IS_NIL(entry->value)) stats->tombstones++;
+            continue;
+        }
+        int home = entry->key->hash % map->capacity;
+        int probe = (i - home + map->capacity) % map->capacity + 1;
+        totalProbe += probe;
+        if (probe > stats->maxProbe) stats->maxProbe = probe;
+        stats->count++;
+    }
+    stats->loadFactor =
+        map->capacity == 0 ? 0 : (double)map->count / map->capacity;
+    stats->averageProbe =
+        stats->count == 0 ? 0 : (double)totalProbe / stats->count;
+}
+
+void getVMStats(VM* vm, VMStats* stats) {
+    stats->instructions = vm->instructionCount;
+    memcpy(stats->opcodeCounts, vm->opcodeCounts, sizeof(vm->opcodeCounts));
+    stats->allocations = allocationCount;
+    stats->bytesAllocated = bytesAllocated;
+    memcpy(stats->objects, vm->objectStats, sizeof(vm->objectStats));
+    getMapStats(&vm->strings, &stats->strings);
+    getMapStats(&vm->globals, &stats->globals);
+    stats->compileNanos = vm->compileNanos;
+    stats->runNanos = vm->runNanos;
+}
+
+static const char* objectTypeNames[OBJ_TYPE_COUNT] = {
+    [OBJ_STRING] = "string",
+    [OBJ_ARRAY] = "array",
+};
+
+static void writeMapJson(const char* name, const MapStats* stats,
+                         FILE* file) {
+    fprintf(file,
+            "  \"%s\": {\"count\": %d, \"capacity\": %d, "
+            "\"tombstones\": %d, \"load_factor\": %.4f, "
+            "\"average_probe\": %.4f, \"max_probe\": %d},\n",
+            name, stats->count, stats->capacity, stats->tombstones,
+            stats->loadFactor, stats->averageProbe, stats->maxProbe);
+}
+
+void writeStatsJson(const VMStats* stats, FILE* file) {
+    fprintf(file, "{\n  \"instructions\": %llu,\n  \"opcodes\": {",
+            (unsigned long long)stats->instructions);
+    bool first = true;
+    for (int i = 0; i < UINT8_COUNT; i++) {
+        if (stats->opcodeCounts[i] == 0) continue;
+        fprintf(file, "%s\"%s\": %llu", first ? "" : ", ",
+                opcodeName((uint8_t)i),
+                (unsigned long long)stats->opcodeCounts[i]);
+        first = false;
+    }
+    fprintf(file, "},\n");
+
+    // bytes_live is what reallocate() currently holds, objects included
+    fprintf(file,
+            "  \"memory\": {\"allocations\": %zu, \"bytes_live\": %zu, "
+            "\"objects\": {",
+            stats->allocations, stats->bytesAllocated);
+    for (int i = 0; i < OBJ_TYPE_COUNT; i++) {
+        const ObjectStats* objects = &stats->objects[i];
+        fprintf(file,
+                "%s\"%s\": {\"allocated\": %llu, \"live\": %llu, "
+                "\"bytes_allocated\": %zu, \"bytes_live\": %zu}",
+                i == 0 ? "" : ", ", objectTypeNames[i],
+                (unsigned long long)objects->allocated,
+                (unsigned long long)objects->live, objects->bytesAllocated,
+                objects->bytesLive);
+    }
+    fprintf(file, "}},\n");
+
+    writeMapJson("strings", &stats->strings, file);
+    writeMapJson("globals", &stats->globals, file);
+    fprintf(file, "  \"compile_ms\": %.3f,\n  \"run_ms\": %.3f\n}\n",
+            stats->compileNanos / 1e6, stats->runNanos / 1e6);
+}
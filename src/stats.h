@@ -0,0 +1,49 @@
+#ifndef clox_stats_h
+#define clox_stats_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "map.h"
+#include "object.h"
+
+typedef struct {
+    uint64_t allocated;
+    uint64_t live;
+    size_t bytesAllocated;
+    size_t bytesLive;
+} ObjectStats;
+
+typedef struct {
+    int count;
+    int capacity;
+    int tombstones;
+    double loadFactor;
+    // slots visited to find a key that is present, 1 is a direct hit
+    double averageProbe;
+    int maxProbe;
+} MapStats;
+
+// a snapshot of the counters the vm keeps, filled in by getVMStats()
+typedef struct {
+    uint64_t instructions;
+    uint64_t opcodeCounts[UINT8_COUNT];
+
+    size_t allocations;
+    size_t bytesAllocated;
+    ObjectStats objects[OBJ_TYPE_COUNT];
+
+    MapStats strings;
+    MapStats globals;
+
+    uint64_t compileNanos;
+    uint64_t runNanos;
+} VMStats;
+
+// memory totals are those of the calling thread
+void getVMStats(VM* vm, VMStats* stats);
+void writeStatsJson(const VMStats* stats, FILE* file);
+
+uint64_t monotonicNanos();
+
+#endif
@@ -3,7 +3,9 @@
 #include <stdio.h>
 #include <string.h>  // for memcmp
 
+#include "array.h"
 #include "memory.h"
+#include "number.h"
 #include "object.h"
 
 void initValueArray(ValueArray* array) {
@@ -31,8 +33,18 @@ void freeValueArray(ValueArray* array) {
 void printObj(Value value) {
     switch (OBJ_TYPE(value)) {
         case OBJ_STRING:
-            printf("%s", AS_CSTRING(value));
+            printf("%.*s", AS_STRING(value)->length, AS_CSTRING(value));
             break;
+        case OBJ_ARRAY: {
+            ObjArray* array = AS_ARRAY(value);
+            printf("[");
+            for (int i = 0; i < array->count; i++) {
+                if (i > 0) printf(", ");
+                printValue(NUMBER_VAL(array->values[i]));
+            }
+            printf("]");
+            break;
+        }
         default:
             printf("unknonw object type in printObj");
     }
@@ -40,7 +52,9 @@ void printObj(Value value) {
 
 void printValue(Value value) {
     if (IS_NUMBER(value)) {
-        printf("%g", AS_NUMBER(value));
+        char buffer[NUMBER_BUFFER_SIZE];
+        int length = formatNumber(AS_NUMBER(value), buffer);
+        printf("%.*s", length, buffer);
     } else if (IS_BOOL(value)) {
         printf(AS_BOOL(value) ? "true" : "false");
     } else if (IS_NIL(value)) {
@@ -64,6 +78,9 @@ bool valuesEqual(Value a, Value b) {
         case VAL_OBJ: {
             // strings are internalized, so we
             // dont need to compare the strings itself
+            if (IS_ARRAY(a) && IS_ARRAY(b)) {
+                return arraysEqual(AS_ARRAY(a), AS_ARRAY(b));
+            }
             return AS_OBJ(a) == AS_OBJ(b);
 
             ObjString* aString = AS_STRING(a);
@@ -4,127 +4,457 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "array.h"
 #include "compiler.h"
 #include "debug.h"
 #include "memory.h"
+#include "natives.h"
 #include "object.h"
+#include "optimize.h"
+#include "probes.h"
+#include "sampler.h"
 #include "stdio.h"
 #include "value.h"
-// singleton VM instance
-VM vm;
+// how often a run with a deadline looks at the clock
+#define DEADLINE_CHECK_INTERVAL 16384
 
-static void resetStack() { vm.stackTop = vm.stack; }
+static void resetStack(VM *vm) { vm->stackTop = vm->stack; }
 
-void initVM() {
-    resetStack();
-    vm.objects = NULL;
-    initMap(&vm.strings);
-    initMap(&vm.globals);
+// forgets a run stopped by its budget along with the machine code of its
+// chunk. the chunk may be freed after this and another one allocated at
+// the same address, which the jit couldn't tell from the old one.
+static void dropSuspended(VM *vm) {
+    vm->suspended = NULL;
+#ifdef ENABLE_JIT
+    freeJit(vm->jit);
+    vm->jit = NULL;
+#endif
+}
+
+static void clearBudget(VM *vm) {
+    vm->instructionLimit = UINT64_MAX;
+    vm->deadline = 0;
+    vm->nextCheck = UINT64_MAX;
+    dropSuspended(vm);
+}
+
+static void resetCounters(VM *vm) {
+    vm->instructionCount = 0;
+    memset(vm->opcodeCounts, 0, sizeof(vm->opcodeCounts));
+    memset(vm->objectStats, 0, sizeof(vm->objectStats));
+    vm->compileNanos = 0;
+    vm->runNanos = 0;
+}
+
+void initVM(VM *vm) {
+    vm->stack = NULL;
+    vm->stackSize = STACK_DEFAULT_SIZE;
+    resetStack(vm);
+    vm->objects = NULL;
+    vm->program = NULL;
+    vm->internShared = false;
+    vm->borrowSource = false;
+    vm->jitEnabled = true;
+    vm->optLevel = OPT_LEVEL_NONE;
+    vm->compileContext = NULL;
+    vm->loopCount = 0;
+    vm->jit = NULL;
+    resetCounters(vm);
+    clearBudget(vm);
+    initMap(&vm->strings);
+    initMap(&vm->globals);
+    initOutput(&vm->output, stdout);
+    vm->errorFile = stderr;
+#ifdef PROFILE_OPCODES
+    initProfile(&vm->profile);
+#endif
+}
+
+void freeVM(VM *vm) {
+#ifdef PROFILE_OPCODES
+    freeProfile(&vm->profile);
+#endif
+    freeMap(&vm->strings);
+    freeMap(&vm->globals);
+    freeObjects(vm);
+    if (vm->stack != NULL) unmapStack(vm->stack, vm->stackSize);
+    if (vm->compileContext != NULL) {
+        freeCompileContext(vm->compileContext);
+        FREE(CompileContext, vm->compileContext);
+    }
+#ifdef ENABLE_JIT
+    freeJit(vm->jit);
+#endif
+    initVM(vm);
+}
+
+void resetVM(VM *vm) {
+    clearMap(&vm->strings);
+    clearMap(&vm->globals);
+    freeObjects(vm);
+    resetStack(vm);
+    resetCounters(vm);
+    clearBudget(vm);
 }
 
-void freeVM() {
-    freeMap(&vm.strings);
-    freeMap(&vm.globals);
-    freeObjects(vm.objects);
-    vm.objects = NULL;
-    initVM(&vm);
+void setStackSize(VM *vm, size_t size) {
+    if (vm->stack != NULL) unmapStack(vm->stack, vm->stackSize);
+    vm->stack = NULL;
+    vm->stackSize = size;
+    dropSuspended(vm);
+    resetStack(vm);
 }
 
-static void runtimeError(const char *format, ...) {
+static void runtimeError(VM *vm, const char *format, ...) {
+    // anything printed so far has to come out before the error
+    flushOutput(&vm->output);
+    // formatted once so the probe can carry the message too
+    char message[256];
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vsnprintf(message, sizeof(message), format, args);
     va_end(args);
-    fprintf(stderr, "\n");
+    fprintf(vm->errorFile, "%s\n", message);
 
-    size_t instruction = vm.ip - vm.chunk->code - 1;
-    int line = vm.chunk->lines[instruction];
-    fprintf(stderr, "[line %d] in script\n", line);
+    size_t instruction = vm->ip - vm->chunk->code - 1;
+    int line = vm->chunk->lines[instruction];
+    fprintf(vm->errorFile, "[line %d] in script\n", line);
+    PROBE2(runtime__error, message, line);
 
-    resetStack();
+    resetStack(vm);
 }
 
-static Value peek(int distance) { return vm.stackTop[-1 - distance]; }
+static Value peek(VM *vm, int distance) {
+    return vm->stackTop[-1 - distance];
+}
 static bool isFalsey(Value value) {
     return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
-static void concatenate() {
-    ObjString *b = AS_STRING(pop());
-    ObjString *a = AS_STRING(pop());
+static ObjString *concatStrings(VM *vm, ObjString *a, ObjString *b) {
     int length = a->length + b->length;
     char *str = ALLOCATE(char, length + 1);
     memcpy(str, a->chars, a->length);
     memcpy(str + a->length, b->chars, b->length);
     str[length] = '\0';
-    ObjString *r = takeString(str, length);
-    push(OBJ_VAL(r));
+    return takeString(vm, str, length);
+}
+
+static void concatenate(VM *vm) {
+    ObjString *b = AS_STRING(pop(vm));
+    ObjString *a = AS_STRING(pop(vm));
+    push(vm, OBJ_VAL(concatStrings(vm, a, b)));
+}
+
+// array[index], false after reporting the error if it fails
+static bool getIndex(VM *vm) {
+    const char *error =
+        arrayGet(vm->stackTop[-2], vm->stackTop[-1], &vm->stackTop[-2]);
+    if (error != NULL) {
+        runtimeError(vm, "%s", error);
+        return false;
+    }
+    vm->stackTop--;
+    return true;
+}
+
+static bool setIndex(VM *vm) {
+    Value value = vm->stackTop[-1];
+    const char *error = arraySet(vm->stackTop[-3], vm->stackTop[-2], value);
+    if (error != NULL) {
+        runtimeError(vm, "%s", error);
+        return false;
+    }
+    vm->stackTop -= 2;
+    vm->stackTop[-1] = value;
+    return true;
+}
+
+static bool native(VM *vm, int index) {
+    const char *error = callNative(vm, index, &vm->stackTop);
+    if (error != NULL) {
+        runtimeError(vm, "%s", error);
+        return false;
+    }
+    return true;
+}
+
+// the cached slot is good as long as it lies in the current table and
+// still holds the name, any rebuild or delete fails one of the two. a
+// slot rather than a pointer, which could point into a freed table or
+// between the entries of a new one.
+static inline Entry *cachedGlobal(VM *vm, uint8_t constant) {
+    ObjString *name = AS_STRING(vm->chunk->constants.values[constant]);
+    Map *globals = &vm->globals;
+    int slot = vm->globalCache[constant];
+    if (slot < globals->capacity && globals->entries[slot].key == name) {
+        return &globals->entries[slot];
+    }
+    Entry *entry = mapFindEntry(globals, name);
+    if (entry != NULL) {
+        vm->globalCache[constant] = (int)(entry - globals->entries);
+    }
+    return entry;
+}
+
+void setBudget(VM *vm, Budget budget) {
+    vm->instructionLimit = budget.instructions == 0
+                               ? UINT64_MAX
+                               : vm->instructionCount + budget.instructions;
+    vm->deadline = budget.nanos == 0 ? 0 : monotonicNanos() + budget.nanos;
+    vm->nextCheck = vm->instructionLimit;
+    if (vm->deadline != 0 &&
+        vm->instructionCount + DEADLINE_CHECK_INTERVAL < vm->nextCheck) {
+        vm->nextCheck = vm->instructionCount + DEADLINE_CHECK_INTERVAL;
+    }
+}
+
+// the slow half of the budget check, true when the run has to stop
+static bool budgetExhausted(VM *vm) {
+    if (vm->instructionCount >= vm->instructionLimit) return true;
+    if (vm->deadline != 0) {
+        if (monotonicNanos() >= vm->deadline) return true;
+        vm->nextCheck = vm->instructionCount + DEADLINE_CHECK_INTERVAL;
+        if (vm->nextCheck > vm->instructionLimit) {
+            vm->nextCheck = vm->instructionLimit;
+        }
+    }
+    return false;
+}
+
+#ifdef REGISTER_VM
+// runs register code, the registers being the slots of the stack
+static InterpretResult runRegisters(VM *vm) {
+    Value *r = vm->stack;
+#define BINARY_OP(valueType, op)                                   \
+    r[a] = valueType(AS_NUMBER(r[b]) op AS_NUMBER(r[c]))
+    for (;;) {
+        vm->instructionCount++;
+        uint8_t instruction = vm->ip[0];
+        uint8_t a = vm->ip[1];
+        uint8_t b = vm->ip[2];
+        uint8_t c = vm->ip[3];
+        vm->ip += REGISTER_INSTRUCTION_SIZE;
+        vm->opcodeCounts[instruction]++;
+        switch (instruction) {
+            case REG_MOVE:
+                r[a] = r[b];
+                break;
+            case REG_LOAD_CONSTANT:
+                r[a] = vm->chunk->constants.values[b];
+                break;
+            case REG_NIL:
+                r[a] = NIL_VAL;
+                break;
+            case REG_TRUE:
+                r[a] = BOOL_VAL(true);
+                break;
+            case REG_FALSE:
+                r[a] = BOOL_VAL(false);
+                break;
+            case REG_EQUAL:
+                r[a] = BOOL_VAL(valuesEqual(r[b], r[c]));
+                break;
+            case REG_LESS:
+                BINARY_OP(BOOL_VAL, <);
+                break;
+            case REG_GREATER:
+                BINARY_OP(BOOL_VAL, >);
+                break;
+            case REG_ADD:
+                if (IS_NUMBER(r[b]) && IS_NUMBER(r[c])) {
+                    BINARY_OP(NUMBER_VAL, +);
+                } else if (IS_STRING(r[b]) && IS_STRING(r[c])) {
+                    ObjString *s =
+                        concatStrings(vm, AS_STRING(r[b]), AS_STRING(r[c]));
+                    r[a] = OBJ_VAL(s);
+                } else {
+                    runtimeError(vm,
+                                 "Operands must be two numbers or two "
+                                 "strings.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            case REG_ADD_NUMBER:
+                BINARY_OP(NUMBER_VAL, +);
+                break;
+            case REG_SUBTRACT:
+                BINARY_OP(NUMBER_VAL, -);
+                break;
+            case REG_MULTIPLY:
+                BINARY_OP(NUMBER_VAL, *);
+                break;
+            case REG_DIVIDE:
+                BINARY_OP(NUMBER_VAL, /);
+                break;
+            case REG_NEGATE:
+                if (!IS_NUMBER(r[b])) return INTERPRET_RUNTIME_ERROR;
+                r[a] = NUMBER_VAL(-AS_NUMBER(r[b]));
+                break;
+            case REG_NEGATE_NUMBER:
+                r[a] = NUMBER_VAL(-AS_NUMBER(r[b]));
+                break;
+            case REG_NOT:
+                r[a] = BOOL_VAL(isFalsey(r[b]));
+                break;
+            case REG_PRINT:
+                writeValue(&vm->output, r[a]);
+                writeOutput(&vm->output, "\n", 1);
+                break;
+            case REG_DEFINE_GLOBAL: {
+                ObjString *name = AS_STRING(vm->chunk->constants.values[b]);
+                mapSet(&vm->globals, name, r[a]);
+                break;
+            }
+            case REG_GET_GLOBAL:
+            case REG_SET_GLOBAL: {
+                Entry *entry = cachedGlobal(vm, b);
+                if (entry == NULL) {
+                    ObjString *name =
+                        AS_STRING(vm->chunk->constants.values[b]);
+                    runtimeError(vm, "Undefined variable '%.*s'", name->length,
+                                 name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (instruction == REG_GET_GLOBAL) {
+                    r[a] = entry->value;
+                } else {
+                    entry->value = r[a];
+                }
+                break;
+            }
+            case REG_JUMP_IF_FALSE:
+                if (isFalsey(r[a])) vm->ip += (b << 8) | c;
+                break;
+            case REG_LOOP:
+                vm->ip -= (b << 8) | c;
+                if (samplerNeedsDrain) drainSamples();
+                if (vm->instructionCount >= vm->nextCheck &&
+                    budgetExhausted(vm)) {
+                    return INTERPRET_BUDGET_EXHAUSTED;
+                }
+                break;
+            case REG_RETURN:
+                return INTERPRET_OK;
+        }
+    }
+#undef BINARY_OP
 }
+#endif
 
-static InterpretResult run() {
-#define READ_BYTE() (*vm.ip++)
-#define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
+static InterpretResult run(VM *vm) {
+#ifdef REGISTER_VM
+    if (vm->chunk->registerCode) return runRegisters(vm);
+#endif
+#define READ_BYTE() (*vm->ip++)
+#define READ_CONSTANT() (vm->chunk->constants.values[READ_BYTE()])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
+#define READ_SHORT() \
+    (vm->ip += 2, (uint16_t)((vm->ip[-2] << 8) | vm->ip[-1]))
     for (;;) {
-#define BINARY_OP(valueType, op)     \
-    do {                             \
-        double b = AS_NUMBER(pop()); \
-        double a = AS_NUMBER(pop()); \
-        push(valueType(a op b));     \
+#define BINARY_OP(valueType, op)       \
+    do {                               \
+        double b = AS_NUMBER(pop(vm)); \
+        double a = AS_NUMBER(pop(vm)); \
+        push(vm, valueType(a op b));   \
     } while (false)
 #ifdef DEBUG_TRACE_EXECUTION
+        flushOutput(&vm->output);
         printf("          ");
-        for (Value *slot = vm.stack; slot < vm.stackTop; slot++) {
+        for (Value *slot = vm->stack; slot < vm->stackTop; slot++) {
             printf("[ ");
             printValue(*slot);
             printf(" ]");
         }
         printf("\n");
-        disassembleInstruction(vm.chunk, (int)(vm.ip - vm.chunk->code));
+        disassembleInstruction(vm->chunk, (int)(vm->ip - vm->chunk->code));
 #endif
-        uint8_t instruction;
-        switch (instruction = READ_BYTE()) {
+        vm->instructionCount++;
+        uint8_t instruction = READ_BYTE();
+        vm->opcodeCounts[instruction]++;
+#ifdef PROFILE_OPCODES
+        profileInstruction(&vm->profile, instruction, vm->ip - 1,
+                           vm->instructionCount);
+#endif
+        switch (instruction) {
             case OP_RETURN:
-                printValue(pop());
-                printf("\n");
                 return INTERPRET_OK;
             case OP_TRUE:
-                push(BOOL_VAL(true));
+                push(vm, BOOL_VAL(true));
                 break;
             case OP_FALSE:
-                push(BOOL_VAL(false));
+                push(vm, BOOL_VAL(false));
                 break;
             case OP_EQUAL: {
-                Value b = pop();
-                Value a = pop();
-                push(BOOL_VAL(valuesEqual(a, b)));
+                Value b = pop(vm);
+                Value a = pop(vm);
+                push(vm, BOOL_VAL(valuesEqual(a, b)));
+                break;
+            }
+            case OP_NOT_EQUAL: {
+                Value b = pop(vm);
+                Value a = pop(vm);
+                push(vm, BOOL_VAL(!valuesEqual(a, b)));
                 break;
             }
             case OP_GREATER:
                 BINARY_OP(BOOL_VAL, >);
                 break;
+            case OP_LESS_CONSTANT:
+                push(vm, READ_CONSTANT());
+                // fall through
             case OP_LESS:
                 BINARY_OP(BOOL_VAL, <);
                 break;
+            // negated rather than <= and >= so that nan compares the same
+            case OP_LESS_EQUAL: {
+                double b = AS_NUMBER(pop(vm));
+                double a = AS_NUMBER(pop(vm));
+                push(vm, BOOL_VAL(!(a > b)));
+                break;
+            }
+            case OP_GREATER_EQUAL: {
+                double b = AS_NUMBER(pop(vm));
+                double a = AS_NUMBER(pop(vm));
+                push(vm, BOOL_VAL(!(a < b)));
+                break;
+            }
             case OP_NIL:
-                push(NIL_VAL);
+                push(vm, NIL_VAL);
                 break;
             case OP_NEGATE:
-                if (!IS_NUMBER(peek(0))) {
+                if (!IS_NUMBER(peek(vm, 0))) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(NUMBER_VAL(-AS_NUMBER(pop())));
+                push(vm, NUMBER_VAL(-AS_NUMBER(pop(vm))));
+                break;
+            case OP_NEGATE_NUMBER:
+                vm->stackTop[-1] = NUMBER_VAL(-AS_NUMBER(vm->stackTop[-1]));
                 break;
             case OP_NOT:
-                push(BOOL_VAL(isFalsey(pop())));
+                push(vm, BOOL_VAL(isFalsey(pop(vm))));
                 break;
+            case OP_ADD_CONSTANT:
+                push(vm, READ_CONSTANT());
+                // fall through
             case OP_ADD:
-                if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
-                    concatenate();
-                } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
+                if (IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1))) {
+                    concatenate(vm);
+                } else if (IS_NUMBER(peek(vm, 0)) && IS_NUMBER(peek(vm, 1))) {
                     BINARY_OP(NUMBER_VAL, +);
+                } else {
+                    runtimeError(vm,
+                                 "Operands must be two numbers or two "
+                                 "strings.");
+                    return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
+            case OP_ADD_NUMBER_CONSTANT:
+                push(vm, READ_CONSTANT());
+                // fall through
+            case OP_ADD_NUMBER:
+                BINARY_OP(NUMBER_VAL, +);
+                break;
             case OP_SUBTRACT:
                 BINARY_OP(NUMBER_VAL, -);
                 break;
@@ -136,49 +466,114 @@ static InterpretResult run() {
                 break;
             case OP_CONSTANT:
                 Value constant = READ_CONSTANT();
-                push(constant);
+                push(vm, constant);
                 break;
             case OP_POP:
-                pop();
+                pop(vm);
+                break;
+            case OP_POPN:
+                vm->stackTop -= READ_BYTE();
                 break;
             case OP_PRINT:
-                printValue(pop());
-                printf("\n");
+                writeValue(&vm->output, pop(vm));
+                writeOutput(&vm->output, "\n", 1);
                 break;
             case OP_DEFINE_GLOBAL: {
                 ObjString *name = READ_STRING();
-                mapSet(&vm.globals, name, peek(0));
-                pop();
+                mapSet(&vm->globals, name, peek(vm, 0));
+                pop(vm);
                 break;
             }
             case OP_GET_GLOBAL: {
-                ObjString *name = READ_STRING();
-                Value value;
-                if (!mapGet(&vm.globals, name, &value)) {
-                    runtimeError("Undefined variable '%s'", name->chars);
+                uint8_t constant = READ_BYTE();
+                Entry *entry = cachedGlobal(vm, constant);
+                if (entry == NULL) {
+                    ObjString *name =
+                        AS_STRING(vm->chunk->constants.values[constant]);
+                    runtimeError(vm, "Undefined variable '%.*s'", name->length,
+                                 name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(value);
+                push(vm, entry->value);
                 break;
             }
-            case OP_SET_GLOBAL: {
-                ObjString *name = READ_STRING();
-                // returns true is the key is new
-                if (mapSet(&vm.globals, name, peek(0))) {
-                    mapDelete(&vm.globals, name);
-                    runtimeError("Undefined variable '%s'", name->chars);
+            case OP_SET_GLOBAL:
+            case OP_SET_GLOBAL_POP: {
+                uint8_t constant = READ_BYTE();
+                Entry *entry = cachedGlobal(vm, constant);
+                if (entry == NULL) {
+                    ObjString *name =
+                        AS_STRING(vm->chunk->constants.values[constant]);
+                    runtimeError(vm, "Undefined variable '%.*s'", name->length,
+                                 name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
+                entry->value = peek(vm, 0);
+                if (instruction == OP_SET_GLOBAL_POP) pop(vm);
                 break;
             }
             case OP_GET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                push(vm.stack[slot]);
+                push(vm, vm->stack[slot]);
                 break;
             }
             case OP_SET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                vm.stack[slot] = peek(0);
+                vm->stack[slot] = peek(vm, 0);
+                break;
+            }
+            case OP_SET_LOCAL_POP: {
+                uint8_t slot = READ_BYTE();
+                vm->stack[slot] = pop(vm);
+                break;
+            }
+            case OP_GET_INDEX:
+                if (!getIndex(vm)) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_SET_INDEX:
+                if (!setIndex(vm)) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_NATIVE:
+                if (!native(vm, READ_BYTE())) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_JUMP_IF_FALSE: {
+                uint16_t offset = READ_SHORT();
+                if (isFalsey(peek(vm, 0))) vm->ip += offset;
+                break;
+            }
+            case OP_JUMP_IF_FALSE_POP: {
+                uint16_t offset = READ_SHORT();
+                if (isFalsey(peek(vm, 0))) {
+                    vm->ip += offset;
+                } else {
+                    pop(vm);
+                }
+                break;
+            }
+            case OP_LOOP: {
+                uint16_t offset = READ_SHORT();
+                vm->ip -= offset;
+                if (samplerNeedsDrain) drainSamples();
+                // every loop passes through here, so a budget checked here
+                // bounds any script
+                if (vm->instructionCount >= vm->nextCheck &&
+                    budgetExhausted(vm)) {
+                    return INTERPRET_BUDGET_EXHAUSTED;
+                }
+#ifdef ENABLE_JIT
+                if (++vm->loopCount >= JIT_THRESHOLD && vm->jitEnabled) {
+                    switch (runJit(vm)) {
+                        case JIT_RETURN:
+                            return INTERPRET_OK;
+                        case JIT_ERROR:
+                            return INTERPRET_RUNTIME_ERROR;
+                        case JIT_BUDGET:
+                            return INTERPRET_BUDGET_EXHAUSTED;
+                        case JIT_INTERPRET:
+                            break;
+                    }
+                }
+#endif
                 break;
             }
         }
@@ -187,37 +582,180 @@ static InterpretResult run() {
 #undef READ_CONSTANT
 #undef BINARY_OP
 #undef READ_STRING
+#undef READ_SHORT
 }
 
-// InterpretResult interpret(Chunk *chunk) {
-//     vm.chunk = chunk;
-//     vm.ip = vm.chunk->code;
-//     return run();
-// }
+#ifdef ENABLE_JIT
+bool jitAdd(VM *vm) {
+    if (IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1))) {
+        concatenate(vm);
+        return true;
+    }
+    runtimeError(vm, "Operands must be two numbers or two strings.");
+    return false;
+}
+
+void jitEqual(VM *vm) {
+    Value b = pop(vm);
+    Value a = pop(vm);
+    push(vm, BOOL_VAL(valuesEqual(a, b)));
+}
 
-InterpretResult interpret(const char *source) {
+void jitPrint(VM *vm) {
+    writeValue(&vm->output, pop(vm));
+    writeOutput(&vm->output, "\n", 1);
+}
+
+void jitDefineGlobal(VM *vm, int constant) {
+    ObjString *name = AS_STRING(vm->chunk->constants.values[constant]);
+    mapSet(&vm->globals, name, peek(vm, 0));
+    pop(vm);
+}
+
+bool jitGetGlobal(VM *vm, int constant) {
+    Entry *entry = cachedGlobal(vm, constant);
+    if (entry == NULL) {
+        ObjString *name = AS_STRING(vm->chunk->constants.values[constant]);
+        runtimeError(vm, "Undefined variable '%.*s'", name->length,
+                     name->chars);
+        return false;
+    }
+    push(vm, entry->value);
+    return true;
+}
+
+bool jitSetGlobal(VM *vm, int constant) {
+    Entry *entry = cachedGlobal(vm, constant);
+    if (entry == NULL) {
+        ObjString *name = AS_STRING(vm->chunk->constants.values[constant]);
+        runtimeError(vm, "Undefined variable '%.*s'", name->length,
+                     name->chars);
+        return false;
+    }
+    entry->value = peek(vm, 0);
+    return true;
+}
+
+bool jitGetIndex(VM *vm) { return getIndex(vm); }
+
+bool jitSetIndex(VM *vm) { return setIndex(vm); }
+
+bool jitNative(VM *vm, int index) { return native(vm, index); }
+
+bool jitLoopCheck(VM *vm) {
+    if (samplerNeedsDrain) drainSamples();
+    return vm->instructionCount >= vm->nextCheck && budgetExhausted(vm);
+}
+#endif
+
+// pushes don't check for overflow, running into the guard page above the
+// stack unwinds straight back here instead
+static InterpretResult guardedRun(VM *vm) {
+    sigjmp_buf overflow;
+    if (sigsetjmp(overflow, 1) != 0) {
+        leaveStackGuard();
+        runtimeError(vm, "Stack overflow.");
+        return INTERPRET_RUNTIME_ERROR;
+    }
+    enterStackGuard(vm->stack, vm->stackSize, &overflow);
+    InterpretResult result = run(vm);
+    leaveStackGuard();
+    return result;
+}
+
+static InterpretResult runChunk(VM *vm, Chunk *chunk) {
+    vm->chunk = chunk;
+    vm->suspended = NULL;
+#ifdef PROFILE_OPCODES
+    profileBeginChunk(&vm->profile, vm->chunk);
+#endif
+    uint64_t start = monotonicNanos();
+    InterpretResult result = guardedRun(vm);
+    vm->runNanos += monotonicNanos() - start;
+#ifdef PROFILE_OPCODES
+    profileEndChunk(&vm->profile);
+#endif
+    flushOutput(&vm->output);
+    if (result == INTERPRET_BUDGET_EXHAUSTED) {
+        vm->suspended = chunk;
+    } else {
+        dropSuspended(vm);
+    }
+    // the sampler must not see the chunk once the caller frees it
+    vm->chunk = NULL;
+    return result;
+}
+
+InterpretResult interpretChunk(VM *vm, Chunk *chunk) {
+    if (vm->stack == NULL) {
+        vm->stack = mapStack(vm->stackSize);
+        if (vm->stack == NULL) {
+            fprintf(vm->errorFile, "Could not allocate the stack.\n");
+            return INTERPRET_RUNTIME_ERROR;
+        }
+    }
+    // a fresh run abandons any that its budget stopped, and the
+    // values that run left behind
+    dropSuspended(vm);
+    vm->ip = chunk->code;
+    vm->loopCount = 0;
+    resetStack(vm);
+    memset(vm->globalCache, 0, sizeof(vm->globalCache));
+#ifdef DEBUG_TRACE_EXECUTION
+    printf("\nrunning...\n");
+#endif
+    return runChunk(vm, chunk);
+}
+
+InterpretResult resumeVM(VM *vm) {
+    if (vm->suspended == NULL) return INTERPRET_RUNTIME_ERROR;
+    // ip, the stack and the global cache are as the run left them
+    return runChunk(vm, vm->suspended);
+}
+
+InterpretResult interpret(VM *vm, const char *source) {
+    PROBE1(interpret__begin, source);
     Chunk chunk;
     initChunk(&chunk);
-    if (!compile(source, &chunk)) {
+    uint64_t start = monotonicNanos();
+    bool compiled = compile(vm, source, &chunk);
+    vm->compileNanos += monotonicNanos() - start;
+    if (!compiled) {
         freeChunk(&chunk);
+        PROBE2(interpret__end, INTERPRET_COMPILE_ERROR, 0);
         return INTERPRET_COMPILE_ERROR;
     }
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code;
-
-    printf("\nrunning...\n");
-    InterpretResult result = run();
+    InterpretResult result = interpretChunk(vm, &chunk);
+    // a run stopped by its budget can't be resumed without its chunk
+    dropSuspended(vm);
     freeChunk(&chunk);
 
-    return INTERPRET_OK;
+    PROBE2(interpret__end, result, vm->instructionCount);
+    return result;
+}
+
+void bindProgram(VM *vm, const Program *program) {
+    if (vm->program == program) return;
+    resetVM(vm);
+    vm->program = program;
+}
+
+InterpretResult interpretProgram(VM *vm, const Program *program) {
+    // there is no source, the program was compiled before
+    PROBE1(interpret__begin, (const char *)NULL);
+    bindProgram(vm, program);
+    // run() never writes to the chunk
+    InterpretResult result = interpretChunk(vm, (Chunk *)&program->chunk);
+    PROBE2(interpret__end, result, vm->instructionCount);
+    return result;
 }
 
-void push(Value value) {
-    *vm.stackTop = value;
-    vm.stackTop++;
+void push(VM *vm, Value value) {
+    *vm->stackTop = value;
+    vm->stackTop++;
 }
 
-Value pop() {
-    vm.stackTop--;
-    return *vm.stackTop;
+Value pop(VM *vm) {
+    vm->stackTop--;
+    return *vm->stackTop;
 }
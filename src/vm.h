@@ -2,32 +2,107 @@
 #define clox_vm_h
 
 #include "chunk.h"
+#include "jit.h"
 #include "map.h"
+#include "output.h"
+#include "profiler.h"
+#include "program.h"
+#include "stack.h"
+#include "stats.h"
 
-#define STACK_MAX 256
+// see compiler.h
+typedef struct CompileContext CompileContext;
 
+// limits on how long a vm may run before it stops, 0 for no limit
 typedef struct {
+    uint64_t instructions;
+    uint64_t nanos;
+} Budget;
+
+// all interpreter state lives here, vms share nothing and can run on
+// different threads at the same time
+struct VM {
     Chunk *chunk;
     uint8_t *ip;
-    Value stack[STACK_MAX];
+    // mapped by the first run, see stack.h
+    Value *stack;
+    size_t stackSize;
     Value *stackTop;
     Obj *objects;
     Map globals;
     Map strings;
-} VM;
+    // the program the vm's globals and strings belong to, see bindProgram()
+    const Program *program;
+    // new strings go to the shared table, set while compiling a program
+    bool internShared;
+    // compiled literals and names borrow their bytes from the source, which
+    // then has to outlive the vm's strings. off unless set.
+    bool borrowSource;
+    // per vm state for the chunk being run, kept off the chunk so that
+    // chunks can be shared: the slot in globals where each constant
+    // index was last found
+    int globalCache[UINT8_COUNT];
+    OutputBuffer output;
+    // compile and runtime errors are reported here
+    FILE *errorFile;
+    uint64_t instructionCount;
+    uint64_t opcodeCounts[UINT8_COUNT];
+    ObjectStats objectStats[OBJ_TYPE_COUNT];
+    uint64_t compileNanos;
+    uint64_t runNanos;
+    // run() checks the budget at backward jumps only, and only once
+    // instructionCount reaches nextCheck
+    uint64_t instructionLimit;
+    uint64_t deadline;
+    uint64_t nextCheck;
+    // the chunk a run that ran out of budget stopped in, see resumeVM()
+    Chunk *suspended;
+    // how hard compile() optimizes, see optimize.h
+    int optLevel;
+    // reused by every compile() on this vm, made by the first one
+    CompileContext *compileContext;
+    // backward jumps taken by this run and the machine code of its chunk
+    // once they pass JIT_THRESHOLD
+    bool jitEnabled;
+    uint32_t loopCount;
+    JitCode *jit;
+#ifdef PROFILE_OPCODES
+    Profile profile;
+#endif
+};
 
 typedef enum {
     INTERPRET_OK,
     INTERPRET_COMPILE_ERROR,
     INTERPRET_RUNTIME_ERROR,
+    // stopped at a backward jump, the run can be resumed
+    INTERPRET_BUDGET_EXHAUSTED,
 } InterpretResult;
 
-void initVM();
-void freeVM();
-void push(Value value);
-Value pop();
+void initVM(VM *vm);
+void freeVM(VM *vm);
+// drops every global and object but keeps the tables allocated, cheaper
+// than freeVM() and initVM() when running one script after another
+void resetVM(VM *vm);
+// the values the stack can hold, rounded up to whole pages. a script
+// that pushes more fails with a stack overflow. drops a suspended run.
+void setStackSize(VM *vm, size_t size);
+void push(VM *vm, Value value);
+Value pop(VM *vm);
 
-// InterpretResult interpret(Chunk *chunk);
-InterpretResult interpret(const char *line);
+InterpretResult interpret(VM *vm, const char *source);
+// runs an already compiled chunk, the caller keeps ownership of it
+InterpretResult interpretChunk(VM *vm, Chunk *chunk);
+// ties the vm to program. a vm bound to another program is reset first,
+// so no globals carry over between programs.
+void bindProgram(VM *vm, const Program *program);
+InterpretResult interpretProgram(VM *vm, const Program *program);
+// budget for the runs from now on, counted from the current instruction
+// and time
+void setBudget(VM *vm, Budget budget);
+// carries on a run that returned INTERPRET_BUDGET_EXHAUSTED, the chunk
+// must still be alive. interpret() frees its chunk, so only runs of
+// interpretChunk() and interpretProgram() can be resumed.
+InterpretResult resumeVM(VM *vm);
 
 #endif
\ No newline at end of file
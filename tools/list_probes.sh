@@ -0,0 +1,28 @@
+#!/bin/sh
+# lists the USDT probes compiled into a clox binary and checks that all of
+# them are there. usage: tools/list_probes.sh path/to/clox
+set -eu
+
+binary=${1:?usage: list_probes.sh path/to/clox}
+expected="compile__begin compile__end interpret__begin interpret__end
+object__alloc string__intern__hit string__intern__miss map__resize
+runtime__error"
+
+found=$(readelf -n "$binary" |
+    awk '/Provider: clox/ { getline; sub(/.*Name: /, ""); print }' |
+    sort -u)
+
+if [ -z "$found" ]; then
+    echo "no clox probes in $binary, was it built without <sys/sdt.h>?" >&2
+    exit 1
+fi
+echo "$found"
+
+missing=0
+for probe in $expected; do
+    if ! echo "$found" | grep -qx "$probe"; then
+        echo "missing probe: $probe" >&2
+        missing=1
+    fi
+done
+exit $missing